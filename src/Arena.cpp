@@ -0,0 +1,180 @@
+#include "Arena.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#define ARENA_ALIGN 16
+
+static size_t	alignUp(size_t n)
+{
+	return ((n + ARENA_ALIGN - 1) & ~static_cast<size_t>(ARENA_ALIGN - 1));
+}
+
+// Header is padded so the first allocation is aligned as well
+static const size_t	blockHeader = (sizeof(void*) + 2 * sizeof(size_t)
+									+ ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+// Constructor
+Arena::Arena(size_t blockSize) : head(NULL), baseSize(alignUp(blockSize)),
+	highWater(0)
+{
+	head = newBlock(baseSize, NULL);
+}
+
+// Destructor
+Arena::~Arena()
+{
+	while (head)
+	{
+		Block *next = head->next;
+		std::free(head);
+		head = next;
+	}
+}
+
+Arena::Block*	Arena::newBlock(size_t size, Block *next)
+{
+	Block *block = static_cast<Block*>(std::malloc(blockHeader + size));
+
+	if (!block)
+		throw std::bad_alloc();
+	block->next = next;
+	block->size = size;
+	block->used = 0;
+	return (block);
+}
+
+size_t	Arena::footprint() const
+{
+	size_t total = 0;
+
+	for (const Block *b = head; b; b = b->next)
+		total += b->used;
+	return (total);
+}
+
+// Getter
+size_t	Arena::getHighWater() const
+{
+	return (highWater);
+}
+
+size_t	Arena::getBlockSize() const
+{
+	return (baseSize);
+}
+
+// Utilities
+void*	Arena::allocate(size_t size)
+{
+	size = alignUp(size ? size : 1);
+	if (head->used + size > head->size)
+	{
+		size_t grow = head->size * 2;
+
+		if (grow < size)
+			grow = size;
+		head = newBlock(grow, head);
+	}
+
+	void *p = reinterpret_cast<char*>(head) + blockHeader + head->used;
+	head->used += size;
+	return (p);
+}
+
+StringRef	Arena::copy(const char *data, size_t len)
+{
+	char *p = static_cast<char*>(allocate(len));
+
+	std::memcpy(p, data, len);
+	return (StringRef(p, len));
+}
+
+// Rewinds to an empty arena. If the last command spilled into extra
+// blocks, they are replaced by one block big enough for all of it.
+void	Arena::reset()
+{
+	size_t used = footprint();
+
+	if (used > highWater)
+		highWater = used;
+
+	if (!head->next)
+	{
+		head->used = 0;
+		return ;
+	}
+
+	size_t total = 0;
+	while (head)
+	{
+		Block *next = head->next;
+		total += head->size;
+		std::free(head);
+		head = next;
+	}
+	head = newBlock(alignUp(total), NULL);
+}
+
+// Constructor
+ArenaString::ArenaString(Arena &arena, size_t capacity) : arena(arena),
+	buf(NULL), len(0), cap(capacity)
+{
+	buf = static_cast<char*>(arena.allocate(cap));
+}
+
+void	ArenaString::reserve(size_t need)
+{
+	if (len + need <= cap)
+		return ;
+
+	size_t newCap = cap * 2;
+	while (newCap < len + need)
+		newCap *= 2;
+
+	char *grown = static_cast<char*>(arena.allocate(newCap));
+	std::memcpy(grown, buf, len);
+	buf = grown;
+	cap = newCap;
+}
+
+// Getter
+StringRef	ArenaString::ref() const
+{
+	return (StringRef(buf, len));
+}
+
+size_t	ArenaString::size() const
+{
+	return (len);
+}
+
+void	ArenaString::clear()
+{
+	len = 0;
+}
+
+// Fragments
+ArenaString&	ArenaString::operator<<(const std::string &text)
+{
+	return (append(text.data(), text.size()));
+}
+
+ArenaString&	ArenaString::operator<<(const StringRef &text)
+{
+	return (append(text.data(), text.size()));
+}
+
+ArenaString&	ArenaString::operator<<(char c)
+{
+	return (append(&c, 1));
+}
+
+ArenaString&	ArenaString::append(const char *data, size_t size)
+{
+	reserve(size);
+	std::memcpy(buf + len, data, size);
+	len += size;
+	return (*this);
+}
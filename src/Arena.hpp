@@ -0,0 +1,98 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include "StringRef.hpp"
+
+#include <string>
+#include <cstddef>
+
+// Bump pointer allocator for everything that only lives while one
+// command is processed: token lists, split JOIN/PART targets and the
+// wire lines handlers compose before queueing them. Allocation is a
+// pointer increment; reset() releases everything at once. When a
+// command outgrows the first block the extra blocks are folded into a
+// single larger one on reset, so steady state does no heap calls.
+class Arena
+{
+	private:
+		struct Block
+		{
+			Block	*next;
+			size_t	size;
+			size_t	used;
+		};
+
+		Block	*head;		// Block currently being carved
+		size_t	baseSize;
+		size_t	highWater;	// Largest footprint seen by reset()
+
+		Arena(); // Block default constructor
+		Arena(const Arena &other); // Block copy
+		Arena&	operator=(const Arena &other);
+
+		static Block*	newBlock(size_t size, Block *next);
+		size_t			footprint() const;
+
+	public:
+		// Constructor
+		explicit Arena(size_t blockSize);
+
+		// Destructor
+		~Arena();
+
+		// Getter
+		size_t	getHighWater() const;
+		size_t	getBlockSize() const;
+
+		// Utilities
+		void*		allocate(size_t size);
+		StringRef	copy(const char *data, size_t len);
+		void		reset();
+
+		template <typename T>
+		T*	allocArray(size_t count)
+		{
+			return (static_cast<T*>(allocate(count * sizeof(T))));
+		}
+};
+
+// Append-only string whose storage lives in an Arena. Meant for
+// composing a wire line that is handed to broadcast()/deliver() and
+// forgotten when the command returns.
+class ArenaString
+{
+	private:
+		Arena	&arena;
+		char	*buf;
+		size_t	len;
+		size_t	cap;
+
+		ArenaString(); // Block default constructor
+
+		void	reserve(size_t need);
+
+	public:
+		// Constructor
+		explicit ArenaString(Arena &arena, size_t capacity = 256);
+
+		// Getter
+		StringRef	ref() const;
+		size_t		size() const;
+
+		// Utilities
+		void	clear();	// Keeps the buffer for reuse
+
+		// Fragments
+		template <size_t N>
+		ArenaString&	operator<<(const char (&fragment)[N])
+		{
+			return (append(fragment, N - 1));
+		}
+		ArenaString&	operator<<(const std::string &text);
+		ArenaString&	operator<<(const StringRef &text);
+		ArenaString&	operator<<(char c);
+
+		ArenaString&	append(const char *data, size_t size);
+};
+
+#endif
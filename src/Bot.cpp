@@ -16,7 +16,7 @@ static int randRange(int lo, int hi)
 }
 
 Bot::Bot(Server& srv, const std::string& nick, const std::string& user)
-: server(&srv), me(new Client(-1)), start(std::time(NULL))
+: server(&srv), me(srv.createClient(-1)), start(std::time(NULL))
 {
     // Authenticated Identity
     me->setNickname(nick);
@@ -29,7 +29,7 @@ Bot::Bot(Server& srv, const std::string& nick, const std::string& user)
 
 Bot::~Bot()
 {
-    delete me;
+    server->destroyClient(me);
 }
 
 const Client* Bot::getIdentityBot() const
@@ -52,44 +52,36 @@ void Bot::registerInServer()
 void Bot::join(const std::string& channelName)
 {
     // Create channel if doesn't exists and add Bor like a user
-    std::map<std::string, Channel*> chans = server->getChannels();
-    Channel* ch = NULL;
-    std::map<std::string, Channel*>::iterator it = chans.find(channelName);
-    if (it == chans.end())
+    Channel* ch = server->findChannel(channelName);
+    if (!ch)
     {
         server->addChannelBot(channelName, ""); // Privat metohd to Bot
-        chans = server->getChannels();
-        ch = chans[channelName];
+        ch = server->findChannel(channelName);
     }
-    else
-        ch = it->second;
-    if (ch)
-        ch->addUser(me);
+    if (!ch)
+        return;
+    ch->addUser(me);
     
     // Msg to JOIN like a normal client
-    std::string joinMsg = ":" + me->getNickname() + "!" + me->getUsername()
-        + "@" + me->getHostname() + " JOIN " + channelName + "\r\n";
-    
-    const std::map<std::string, const Client*>& users = ch->getUsers();
-    for (std::map<std::string, const Client*>::const_iterator ui = users.begin(); ui != users.end(); ++ui)
-        server->sendRaw(ui->second, joinMsg); 
+    server->broadcast(ch, me->getPrefix() + " JOIN " + channelName + "\r\n");
 }
 
 void Bot::onUserJoinedChannel(const Channel* ch, const Client* who)
 {
     if (!ch || !who) return;
     // If Bot is in channel, send a msg
-    const std::map<std::string, const Client*>& users = ch->getUsers();
-    if (users.find(me->getNickname()) != users.end())
+    if (ch->hasMember(me))
     {
         replyChannel(ch->getName(), "Welcome " + who->getNickname() + " 👋 — try !help to see commands");
     }
 }
 
-void Bot::onChannelMessage(const Channel* ch, const Client* from, const std::string& text)
+void Bot::onChannelMessage(const Channel* ch, const Client* from, const StringRef& message)
 {
     if (!ch || !from) return;
-    if (text.empty() || text[0] != '!') return; // Prefx cmds
+    if (message.empty() || message[0] != '!') return; // Prefx cmds
+
+    std::string text = message.str();
 
     std::string cmd, rest;
     size_t sp = text.find(' ');
@@ -119,20 +111,13 @@ void Bot::onDirectMessage(const Client* from, const std::string& text)
 void Bot::replyChannel(const std::string& channel, const std::string& text)
  {
     // Send a PRIVMSG to everyone like a real client
-    std::map<std::string, Channel*> chans = server->getChannels();
-    std::map<std::string, Channel*>::iterator it = chans.find(channel);
-    if (it == chans.end())
+    const Channel* ch = server->findChannel(channel);
+    if (!ch)
         return;
 
-    const std::map<std::string, const Client*>& users = it->second->getUsers();
-    for (std::map<std::string, const Client*>::const_iterator ui = users.begin(); ui != users.end(); ++ui)
-    {
-        if (ui->second != me)
-        {
-            // Ignore Bots
-            server->sendPrivMsg(me, channel, ui->second, text); 
-        }
-    }
+    // Ignore Bots
+    server->broadcast(ch, me->getPrefix() + " PRIVMSG " + channel
+                        + " :" + text + "\r\n", me);
 }
 
 void Bot::replyUser(const Client* to, const std::string& text)
@@ -7,6 +7,7 @@
 class Server;
 class Client;
 class Channel;
+class StringRef;
 
 class Bot
 {
@@ -26,7 +27,7 @@ class Bot
 
         // Server Hooks
         void onUserJoinedChannel(const Channel* ch, const Client* who);
-        void onChannelMessage(const Channel* ch, const Client* from, const std::string& text);
+        void onChannelMessage(const Channel* ch, const Client* from, const StringRef& message);
         void onDirectMessage(const Client* from, const std::string& text);
 
     private:
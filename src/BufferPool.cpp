@@ -0,0 +1,25 @@
+#include "BufferPool.hpp"
+#include "config.hpp"
+
+FixedPool	BufferPool::pool("io-segment", sizeof(BufferSegment),
+				serverConfig::slabBytes, serverConfig::hugePages);
+
+BufferSegment*	BufferPool::acquire()
+{
+	BufferSegment *segment = static_cast<BufferSegment*>(pool.allocate());
+
+	segment->next = NULL;
+	segment->start = 0;
+	segment->end = 0;
+	return (segment);
+}
+
+void	BufferPool::release(BufferSegment *segment)
+{
+	pool.release(segment);
+}
+
+const PoolStats&	BufferPool::getStats()
+{
+	return (pool.getStats());
+}
@@ -0,0 +1,38 @@
+#ifndef BUFFERPOOL_HPP
+#define BUFFERPOOL_HPP
+
+#include "Pool.hpp"
+
+#include <cstddef>
+
+#define BUFFER_SEGMENT_SIZE 4096
+
+// Fixed size I/O buffer segment, chained to form a connection's queue
+struct BufferSegment
+{
+	BufferSegment	*next;
+	size_t			start;	// First unread byte
+	size_t			end;	// One past the last written byte
+
+	static const size_t	capacity = BUFFER_SEGMENT_SIZE
+							- sizeof(BufferSegment*) - 2 * sizeof(size_t);
+
+	char			data[capacity];
+};
+
+// Process wide pool of I/O segments shared by every connection
+class BufferPool
+{
+	private:
+		static FixedPool	pool;
+
+		BufferPool(); // Block default constructor
+
+	public:
+		static BufferSegment*	acquire();
+		static void				release(BufferSegment *segment);
+
+		static const PoolStats&	getStats();
+};
+
+#endif
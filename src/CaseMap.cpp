@@ -0,0 +1,81 @@
+#include "CaseMap.hpp"
+
+#include <stdexcept>
+
+namespace
+{
+	struct FoldTable
+	{
+		CaseMap::Mode	mode;
+		char			map[256];
+
+		FoldTable() { build(CaseMap::RFC1459); }
+
+		void	build(CaseMap::Mode newMode)
+		{
+			mode = newMode;
+			for (int c = 0; c < 256; ++c)
+				map[c] = static_cast<char>(c);
+			for (int c = 'A'; c <= 'Z'; ++c)
+				map[c] = static_cast<char>(c + ('a' - 'A'));
+			if (mode == CaseMap::RFC1459)
+			{
+				map[static_cast<unsigned char>('[')] = '{';
+				map[static_cast<unsigned char>(']')] = '}';
+				map[static_cast<unsigned char>('\\')] = '|';
+				map[static_cast<unsigned char>('~')] = '^';
+			}
+		}
+	};
+
+	FoldTable	table;
+}
+
+namespace CaseMap
+{
+	void	configure(const std::string &name)
+	{
+		if (name == "rfc1459")
+			table.build(RFC1459);
+		else if (name == "ascii")
+			table.build(ASCII);
+		else
+			throw std::runtime_error("Unknown casemapping: " + name);
+	}
+
+	Mode	getMode()
+	{
+		return (table.mode);
+	}
+
+	const char*	getName()
+	{
+		return (table.mode == RFC1459 ? "rfc1459" : "ascii");
+	}
+
+	char	foldChar(char c)
+	{
+		return (table.map[static_cast<unsigned char>(c)]);
+	}
+
+	std::string	fold(const std::string &str)
+	{
+		std::string	folded(str);
+
+		for (size_t i = 0; i < folded.size(); ++i)
+			folded[i] = table.map[static_cast<unsigned char>(folded[i])];
+		return (folded);
+	}
+
+	bool	equals(const std::string &a, const std::string &b)
+	{
+		if (a.size() != b.size())
+			return (false);
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			if (foldChar(a[i]) != foldChar(b[i]))
+				return (false);
+		}
+		return (true);
+	}
+}
@@ -0,0 +1,25 @@
+#ifndef CASEMAP_HPP
+#define CASEMAP_HPP
+
+#include <string>
+
+// Nick and channel name casefolding (ISUPPORT CASEMAPPING).
+// "rfc1459" also folds []\~ onto {}|^, "ascii" only folds A-Z.
+namespace CaseMap
+{
+	enum Mode
+	{
+		ASCII,
+		RFC1459
+	};
+
+	void		configure(const std::string &name);
+	Mode		getMode();
+	const char*	getName();
+
+	char		foldChar(char c);
+	std::string	fold(const std::string &str);
+	bool		equals(const std::string &a, const std::string &b);
+}
+
+#endif
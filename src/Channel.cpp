@@ -1,23 +1,44 @@
 #include "Channel.hpp"
 #include "Client.hpp"
+#include "ChannelIndex.hpp"
+#include "CaseMap.hpp"
+#include "config.hpp"
+
+#include <algorithm>
 
 // Constructor
+// Budget left for names in ":server 353 <nick> = <channel> :...\r\n"
+static size_t	namesBudget(const std::string &channel)
+{
+	size_t fixed = (sizeof(":" SERVER_NAME " 353 ") - 1) + serverConfig::nickLen
+					+ 3 + channel.size() + 2 + 2;
+
+	return (fixed < 512 ? 512 - fixed : 0);
+}
+
 Channel::Channel(const std::string &name, const std::string &topic)	: name(name),
-					topic(topic), key(""), userLimit(-1), inviteOnly(false),
-					topicBlocked(true) {}
+					topic(topic), foldedName(CaseMap::fold(name)),
+					foldedTopic(CaseMap::fold(topic)), key(""), names(namesBudget(name)), sizeIndex(NULL),
+					userLimit(-1), inviteOnly(false), topicBlocked(true)
+{
+	for (int i = 0; i < MASK_LISTS; ++i)
+		masks[i] = NULL;
+}
 
 // Destructor
 Channel::~Channel()
 {
-	users.clear();
-	operators.clear();
+	setSizeIndex(NULL);
+	members.clear();
 	invited.clear();
+	for (int i = 0; i < MASK_LISTS; ++i)
+		MaskSet::release(masks[i]);
 }
 
 // Getter
 const std::string&	Channel::getName() const
 {
-	return (this->name);
+	return (this->name.str());
 }
 
 const std::string&	Channel::getTopic() const
@@ -25,6 +46,16 @@ const std::string&	Channel::getTopic() const
 	return (this->topic);
 }
 
+const std::string&	Channel::getFoldedName() const
+{
+	return (this->foldedName);
+}
+
+const std::string&	Channel::getFoldedTopic() const
+{
+	return (this->foldedTopic);
+}
+
 const std::string&	Channel::getKey() const
 {
 	return (this->key);
@@ -45,25 +76,61 @@ bool	Channel::isTopicBlocked() const
 	return (this->topicBlocked);
 }
 
-const std::map<std::string, const Client*>&	Channel::getUsers() const
+const MemberSet&	Channel::getMembers() const
 {
-	return (this->users);
+	return (this->members);
 }
 
-const std::set<const Client*>&	Channel::getOperators() const
+const std::vector<unsigned int>&	Channel::getInvited() const
 {
-	return (this->operators);
+	return (this->invited);
 }
 
-const std::set<const Client*>&	Channel::getInvited() const
+size_t	Channel::getMemberCount() const
 {
-	return (this->invited);
+	return (this->members.size());
+}
+
+const Channel::Member*	Channel::findMember(unsigned int id) const
+{
+	return (members.find(id));
+}
+
+bool	Channel::hasMember(const Client *client) const
+{
+	return (client && findMember(client->getId()) != NULL);
+}
+
+bool	Channel::isOperator(const Client *client) const
+{
+	const Member *member = client ? findMember(client->getId()) : NULL;
+
+	return (member && (member->roles & ROLE_OPERATOR));
+}
+
+NamesCache&	Channel::getNamesCache() const
+{
+	return (this->names);
+}
+
+std::string	Channel::namesEntry(const std::string &nick, unsigned int roles)
+{
+	if (roles & ROLE_OPERATOR)
+		return ("@" + nick);
+	return (nick);
+}
+
+bool	Channel::isInvited(const Client *client) const
+{
+	return (client && std::find(invited.begin(), invited.end(), client->getId())
+				!= invited.end());
 }
 
 // Setter
 void	Channel::setTopic(const std::string &newTopic)
 {
 	this->topic = newTopic;
+	this->foldedTopic = CaseMap::fold(newTopic);
 }
 
 void	Channel::setKey(const std::string &newKey)
@@ -86,53 +153,140 @@ void	Channel::setTopicBlocked(bool topicBlocked)
 	this->topicBlocked = topicBlocked;
 }
 
+// Moves this channel's entry to index (NULL just removes it)
+void	Channel::setSizeIndex(ChannelIndex *index)
+{
+	if (sizeIndex)
+		sizeIndex->erase(this, members.size());
+	sizeIndex = index;
+	if (sizeIndex)
+		sizeIndex->insert(this, members.size());
+}
+
 // Utilities
-void	Channel::addUser(const Client *newUser)
+void	Channel::addUser(Client *newUser)
 {
-	if (users.find(newUser->getNickname()) == users.end())
-	{
-		users[newUser->getNickname()] = newUser;
+	// The first member becomes the channel operator
+	unsigned int roles = members.empty() ? ROLE_OPERATOR : 0;
 
-		if (this->users.size() == 1)
-		{
-			addOperator(newUser);
-		}
+	if (!members.insert(newUser->getId(), roles))
+		return ;
+	if (sizeIndex)
+		sizeIndex->update(this, members.size() - 1, members.size());
+	newUser->addChannel(this);
+	names.append(namesEntry(newUser->getNickname(), roles));
 
-		if (this->isInviteOnly())
-		{
-			removeInvited(newUser);
-		}
+	if (this->isInviteOnly())
+	{
+		removeInvited(newUser);
 	}
 }
 
 void	Channel::addOperator(const Client *newOperator)
 {
-	if (operators.find(newOperator) == operators.end())
-		operators.insert(newOperator);
+	Member *member = members.find(newOperator->getId());
+
+	if (member && !(member->roles & ROLE_OPERATOR))
+	{
+		member->roles |= ROLE_OPERATOR;
+		names.replace(newOperator->getNickname(),
+			namesEntry(newOperator->getNickname(), member->roles));
+	}
 }
 
-void	Channel::addInvited(const Client *newInvited)
+void	Channel::addInvited(Client *newInvited)
 {
-	if (invited.find(newInvited) == invited.end())
-		invited.insert(newInvited);
+	if (!isInvited(newInvited))
+	{
+		invited.push_back(newInvited->getId());
+		newInvited->addInvite(this);
+	}
 }
 
-void	Channel::removeUser(const std::string &nickname)
+void	Channel::removeUser(Client *client)
 {
-	users.erase(nickname);
+	const Member *member = members.find(client->getId());
+
+	if (!member)
+		return ;
+	names.remove(namesEntry(client->getNickname(), member->roles));
+	members.erase(client->getId());
+	if (sizeIndex)
+		sizeIndex->update(this, members.size() + 1, members.size());
+	client->removeChannel(this);
 }
 
 void	Channel::removeOperator(const Client *client)
 {
-	operators.erase(client);
+	Member *member = members.find(client->getId());
+
+	if (member && (member->roles & ROLE_OPERATOR))
+	{
+		std::string oldEntry = namesEntry(client->getNickname(), member->roles);
+
+		member->roles &= ~static_cast<unsigned int>(ROLE_OPERATOR);
+		names.replace(oldEntry, namesEntry(client->getNickname(), member->roles));
+	}
 }
 
-void	Channel::removeInvited(const Client *client)
+const MaskSet*	Channel::getMaskList(MaskList list) const
 {
-	invited.erase(client);
+	return (masks[list]);
 }
 
-void	Channel::cleanInvited()
+// Banned unless an exception also matches
+bool	Channel::isBanned(const Client *client) const
 {
-	invited.clear();
+	if (!masks[BAN_LIST] || !masks[BAN_LIST]->matches(*client))
+		return (false);
+	return (!masks[EXCEPT_LIST] || !masks[EXCEPT_LIST]->matches(*client));
+}
+
+bool	Channel::isInviteExempt(const Client *client) const
+{
+	return (masks[INVEX_LIST] && masks[INVEX_LIST]->matches(*client));
+}
+
+// Replaces a whole list; masks may be reordered by the call
+void	Channel::setMaskList(MaskList list, std::vector<std::string> &masks)
+{
+	this->masks[list] = MaskSet::replace(this->masks[list], masks);
+}
+
+// Membership is keyed by id, so a nick change only rewrites the names entry
+void	Channel::renameMember(const Client *client, const std::string &oldNick)
+{
+	const Member *member = members.find(client->getId());
+
+	if (member)
+	{
+		names.replace(namesEntry(oldNick, member->roles),
+			namesEntry(client->getNickname(), member->roles));
+	}
+}
+
+// Forgets an invite whose client no longer exists
+void	Channel::dropInvited(unsigned int id)
+{
+	std::vector<unsigned int>::iterator it
+		= std::find(invited.begin(), invited.end(), id);
+
+	if (it != invited.end())
+	{
+		*it = invited.back();
+		invited.pop_back();
+	}
+}
+
+void	Channel::removeInvited(Client *client)
+{
+	std::vector<unsigned int>::iterator it
+		= std::find(invited.begin(), invited.end(), client->getId());
+
+	if (it != invited.end())
+	{
+		*it = invited.back();
+		invited.pop_back();
+		client->removeInvite(this);
+	}
 }
@@ -1,24 +1,52 @@
 #ifndef CHANNEL_HPP
 #define CHANNEL_HPP
 
+#include "IString.hpp"
+#include "MemberSet.hpp"
+#include "NamesCache.hpp"
+#include "MaskSet.hpp"
+
 #include <string>
-#include <set>
-#include <map>
+#include <vector>
 
 class Client;
+class ChannelIndex;
 
 class Channel
 {
+	public:
+		// Member role bits
+		enum Role
+		{
+			ROLE_OPERATOR = 1 << 0
+		};
+
+		// +b, +e and +I lists
+		enum MaskList
+		{
+			BAN_LIST,
+			EXCEPT_LIST,
+			INVEX_LIST,
+			MASK_LISTS
+		};
+
+		// Compact membership record (client id + role bits)
+		typedef MemberSet::Member	Member;
+
 	private:
-		std::string								name;
-		std::string								topic;
-		std::string								key;
-		std::map<std::string, const Client*>	users;
-		std::set<const Client*>					operators;
-		std::set<const Client*>					invited;
-		int										userLimit;
-		bool									inviteOnly;
-		bool									topicBlocked;
+		IString						name;
+		std::string					topic;
+		std::string					foldedName;		// For LIST filters
+		std::string					foldedTopic;	// Kept in step by setTopic()
+		std::string					key;
+		MemberSet					members;
+		mutable NamesCache			names;	// Rendered 353 payload
+		std::vector<unsigned int>	invited;
+		const MaskSet*				masks[MASK_LISTS];	// Shared, NULL if empty
+		ChannelIndex				*sizeIndex;	// Kept current on join/part
+		int							userLimit;
+		bool						inviteOnly;
+		bool						topicBlocked;
 
 		Channel(); //Block default constructor
 
@@ -32,14 +60,27 @@ class Channel
 		// Getter
 		const std::string&	getName() const;
 		const std::string&	getTopic() const;
+		const std::string&	getFoldedName() const;
+		const std::string&	getFoldedTopic() const;
 		const std::string&	getKey() const;
 		int					getUserLimit() const;
 		bool				isInviteOnly() const;
 		bool				isTopicBlocked() const;
 
-		const std::map<std::string, const Client*>&	getUsers() const;
-		const std::set<const Client*>&	getOperators() const;
-		const std::set<const Client*>&	getInvited() const;
+		const MemberSet&					getMembers() const;
+		const std::vector<unsigned int>&	getInvited() const;
+		size_t								getMemberCount() const;
+		const Member*						findMember(unsigned int id) const;
+		bool								hasMember(const Client *client) const;
+		bool								isOperator(const Client *client) const;
+		bool								isInvited(const Client *client) const;
+		NamesCache&							getNamesCache() const;
+		const MaskSet*						getMaskList(MaskList list) const;
+		bool								isBanned(const Client *client) const;
+		bool								isInviteExempt(const Client *client) const;
+
+		// "[@]nick" as listed in RPL_NAMREPLY
+		static std::string	namesEntry(const std::string &nick, unsigned int roles);
 
 		// Setter
 		void	setTopic(const std::string &newTopic);
@@ -47,17 +88,18 @@ class Channel
 		void	setUserLimit(int newLimit);
 		void	setInviteOnly(bool inviteOnly);
 		void	setTopicBlocked(bool topicBlocked);
+		void	setSizeIndex(ChannelIndex *index);
 
 		// Utilities
-		void	addUser(const Client* newUser);
+		void	addUser(Client* newUser);
 		void	addOperator(const Client* newOperator);
-		void	addInvited(const Client* newInvited);
-		void	removeUser(const std::string &nickname);
+		void	addInvited(Client* newInvited);
+		void	removeUser(Client *client);
 		void	removeOperator(const Client* client);
-		void	removeInvited(const Client* client);
-
-		void	cleanInvited();
-
+		void	removeInvited(Client* client);
+		void	renameMember(const Client *client, const std::string &oldNick);
+		void	setMaskList(MaskList list, std::vector<std::string> &masks);
+		void	dropInvited(unsigned int id);
 };
 
 #endif
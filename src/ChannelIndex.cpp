@@ -0,0 +1,90 @@
+#include "ChannelIndex.hpp"
+#include "Channel.hpp"
+#include "MaskSet.hpp"
+
+static ChannelIndex::Entry	makeEntry(const Channel *channel, size_t users)
+{
+	ChannelIndex::Entry	entry;
+
+	entry.users = users;
+	entry.channel = channel;
+	return (entry);
+}
+
+bool	ChannelIndex::Order::operator()(const Entry &a, const Entry &b) const
+{
+	if (a.users != b.users)
+		return (a.users > b.users);
+	return (a.channel < b.channel);
+}
+
+// ------------- Query -----------//
+
+ChannelIndex::Query::Query() : minUsers(0), maxUsers(0) {}
+
+bool	ChannelIndex::Query::accepts(const Channel *channel) const
+{
+	if (!mask.empty() && !MaskSet::matchMask(mask, channel->getFoldedName()))
+		return (false);
+	if (!topic.empty() && channel->getFoldedTopic().find(topic) == std::string::npos)
+		return (false);
+	return (true);
+}
+
+ChannelIndex::Cursor::Cursor() : last(makeEntry(NULL, 0)), started(false),
+	done(false) {}
+
+// ------------- ChannelIndex -----------//
+
+// Getter
+size_t	ChannelIndex::size() const
+{
+	return (entries.size());
+}
+
+// Utilities
+void	ChannelIndex::insert(const Channel *channel, size_t users)
+{
+	entries.insert(makeEntry(channel, users));
+}
+
+void	ChannelIndex::update(const Channel *channel, size_t oldUsers, size_t newUsers)
+{
+	entries.erase(makeEntry(channel, oldUsers));
+	entries.insert(makeEntry(channel, newUsers));
+}
+
+void	ChannelIndex::erase(const Channel *channel, size_t users)
+{
+	entries.erase(makeEntry(channel, users));
+}
+
+const Channel*	ChannelIndex::next(Cursor &cursor, size_t &budget) const
+{
+	const Query			&query = cursor.query;
+	Set::const_iterator	it;
+
+	if (cursor.done)
+		return (NULL);
+	if (cursor.started)
+		it = entries.upper_bound(cursor.last);
+	else if (query.maxUsers)	// Skip straight past the larger channels
+		it = entries.lower_bound(makeEntry(NULL, query.maxUsers - 1));
+	else
+		it = entries.begin();
+
+	for (; it != entries.end() && budget > 0; ++it)
+	{
+		if (query.minUsers && it->users <= query.minUsers)
+			break ;
+
+		--budget;
+		cursor.last = *it;
+		cursor.started = true;
+		if (query.accepts(it->channel))
+			return (it->channel);
+	}
+	if (budget > 0)
+		cursor.done = true;
+	return (NULL);
+}
@@ -0,0 +1,73 @@
+#ifndef CHANNELINDEX_HPP
+#define CHANNELINDEX_HPP
+
+#include <string>
+#include <set>
+#include <cstddef>
+
+class Channel;
+
+// Live channels ordered by member count, largest first, for LIST. Each
+// Channel keeps its own entry current as members come and go. A Cursor
+// remembers the last entry it visited by value, so a listing can be
+// resumed on a later loop tick even if channels were created, resized or
+// destroyed in between (a channel that moved may be seen twice or not
+// at all, which LIST tolerates).
+class ChannelIndex
+{
+	public:
+		struct Entry
+		{
+			size_t			users;
+			const Channel	*channel;	// Compared only, never followed from a cursor
+		};
+
+		// LIST filters; user bounds are exclusive, 0 means no bound. Only
+		// size is indexed: mask and topic are tested on every channel the
+		// walk visits, against the folded text each Channel caches
+		struct Query
+		{
+			size_t		minUsers;
+			size_t		maxUsers;
+			std::string	mask;	// Folded channel name mask, empty = any
+			std::string	topic;	// Folded topic substring, empty = any
+
+			Query();
+			bool	accepts(const Channel *channel) const;
+		};
+
+		struct Cursor
+		{
+			Query	query;
+			Entry	last;
+			bool	started;
+			bool	done;
+
+			Cursor();
+		};
+
+	private:
+		struct Order
+		{
+			bool	operator()(const Entry &a, const Entry &b) const;
+		};
+
+		typedef std::set<Entry, Order>	Set;
+
+		Set		entries;
+
+	public:
+		// Getter
+		size_t	size() const;
+
+		// Utilities
+		void	insert(const Channel *channel, size_t users);
+		void	update(const Channel *channel, size_t oldUsers, size_t newUsers);
+		void	erase(const Channel *channel, size_t users);
+
+		// Next channel matching cursor's query, NULL when the listing is
+		// done or budget (entries visited) ran out for this call
+		const Channel*	next(Cursor &cursor, size_t &budget) const;
+};
+
+#endif
@@ -1,15 +1,19 @@
 #include "Client.hpp"
+#include "CaseMap.hpp"
 
 #include <unistd.h>
+#include <algorithm>
+#include <cstring>
 
 // Constructor
-Client::Client(int fd) : clientFd(fd), nickname(""), username(""),
-	passwordAccepted(false), authenticated(false), isInvisible(false), buffer("") {}
+Client::Client(int fd) : clientFd(fd), id(noId), nickname(), username(),
+	prefixVersion(0), passwordAccepted(false), authenticated(false), isInvisible(false), flushQueued(false), caps(0), input(NULL) {}
 
 
 // Destructor
 Client::~Client()
 {
+	releaseInput();
 	if (clientFd >= 0)
 	{
 		close(clientFd);
@@ -23,19 +27,55 @@ int	Client::getClientFd() const
 	return (this->clientFd);
 }
 
+unsigned int	Client::getId() const
+{
+	return (this->id);
+}
+
+const std::vector<Channel*>&	Client::getChannels() const
+{
+	return (this->channels);
+}
+
+const std::vector<Channel*>&	Client::getInvites() const
+{
+	return (this->invites);
+}
+
+const std::vector<std::string>&	Client::getMonitored() const
+{
+	return (this->monitored);
+}
+
 const std::string&	Client::getNickname() const
 {
-	return (this->nickname);
+	return (this->nickname.str());
 }
 
 const std::string&	Client::getUsername() const
 {
-	return (this->username);
+	return (this->username.str());
 }
 
 const std::string&	Client::getHostname() const
 {
-	return (this->hostname);
+	return (this->hostname.str());
+}
+
+const std::string&	Client::getRealname() const
+{
+	return (this->realname);
+}
+
+// ":nick!user@host", rebuilt only when one of its parts changes
+const std::string&	Client::getPrefix() const
+{
+	return (this->prefix);
+}
+
+unsigned	Client::getPrefixVersion() const
+{
+	return (this->prefixVersion);
 }
 
 bool	Client::isPasswordAccepted() const
@@ -53,22 +93,37 @@ bool	Client::getIsInvisible() const
 	return (this->isInvisible);
 }
 
-const std::string&	Client::getBuffer() const
+bool	Client::isFlushQueued() const
 {
-	return (this->buffer);
+	return (this->flushQueued);
 }
 
-std::string&	Client::getBuffer()
+unsigned	Client::getCaps() const
 {
-	return (this->buffer);
+	return (this->caps);
 }
 
-const std::string&	Client::getBufferOut() const
+bool	Client::hasCap(Capability cap) const
+{
+	return ((this->caps & cap) != 0);
+}
+
+BufferSegment*	Client::getInput()
+{
+	return (this->input);
+}
+
+MatchCache&	Client::getMatchCache() const
+{
+	return (this->matchCache);
+}
+
+const OutputBuffer&	Client::getBufferOut() const
 {
 	return (this->bufferOut);
 }
 
-std::string&	Client::getBufferOut()
+OutputBuffer&	Client::getBufferOut()
 {
 	return (this->bufferOut);
 }
@@ -79,19 +134,32 @@ void	Client::setClientFd(int fd)
 	this->clientFd = fd;
 }
 
+void	Client::setId(unsigned int id)
+{
+	this->id = id;
+}
+
 void	Client::setNickname(const std::string &nickname)
 {
-	this->nickname = nickname;
+	this->nickname = IString(nickname);
+	updatePrefix();
 }
 
 void	Client::setUsername(const std::string &username)
 {
-	this->username = username;
+	this->username = IString(username);
+	updatePrefix();
 }
 
 void	Client::setHostname(const std::string &hostname)
 {
-	this->hostname = hostname;
+	this->hostname = IString(hostname);
+	updatePrefix();
+}
+
+void	Client::setRealname(const std::string &realname)
+{
+	this->realname = realname;
 }
 
 void	Client::setPasswordAccepted(bool isAccepted)
@@ -109,13 +177,125 @@ void	Client::setIsInvisible(bool isNotVisible)
 	this->isInvisible = isNotVisible;
 }
 
+void	Client::setFlushQueued(bool queued)
+{
+	this->flushQueued = queued;
+}
+
+void	Client::setCaps(unsigned caps)
+{
+	this->caps = caps;
+}
+
 // Utilities
-void	Client::appendToBuffer(const std::string &newData)
+void	Client::updatePrefix()
 {
-	this->buffer += newData;
+	prefix.clear();
+	prefix.reserve(nickname.size() + username.size() + hostname.size() + 3);
+	prefix += ':';
+	prefix += nickname.str();
+	prefix += '!';
+	prefix += username.str();
+	prefix += '@';
+	prefix += hostname.str();
+	++prefixVersion;
 }
 
-void	Client::appendToBufferOut(const std::string &newData)
+// Keeps the unterminated tail of the input. It may already live in this
+// client's segment (then it is moved to the front) or in the server's
+// shared read buffer (then a segment is borrowed for it). Nothing left
+// means the segment goes back to the pool.
+void	Client::stashInput(const char *data, size_t len)
 {
-	this->bufferOut += newData;
+	if (len == 0)
+	{
+		releaseInput();
+		return ;
+	}
+
+	if (!input)
+		input = BufferPool::acquire();
+	std::memmove(input->data, data, len);
+	input->start = 0;
+	input->end = len;
+}
+
+void	Client::releaseInput()
+{
+	if (input)
+	{
+		BufferPool::release(input);
+		input = NULL;
+	}
+}
+
+// Approximate bytes this connection owns, including pooled buffers
+size_t	Client::getFootprint() const
+{
+	size_t bytes = sizeof(Client) + prefix.capacity()
+		+ (channels.capacity() + invites.capacity()) * sizeof(Channel*)
+		+ monitored.capacity() * sizeof(std::string);
+
+	if (input)
+		bytes += sizeof(BufferSegment);
+	bytes += (bufferOut.size() + BufferSegment::capacity - 1)
+				/ BufferSegment::capacity * sizeof(BufferSegment);
+	return (bytes);
+}
+
+
+static void	eraseChannel(std::vector<Channel*> &list, Channel *channel)
+{
+	std::vector<Channel*>::iterator it = std::find(list.begin(), list.end(), channel);
+
+	if (it != list.end())
+	{
+		*it = list.back();
+		list.pop_back();
+	}
+}
+
+void	Client::addChannel(Channel *channel)
+{
+	this->channels.push_back(channel);
+}
+
+void	Client::removeChannel(Channel *channel)
+{
+	eraseChannel(this->channels, channel);
+}
+
+void	Client::addInvite(Channel *channel)
+{
+	this->invites.push_back(channel);
+}
+
+void	Client::removeInvite(Channel *channel)
+{
+	eraseChannel(this->invites, channel);
+}
+
+bool	Client::addMonitored(const std::string &nick)
+{
+	for (size_t i = 0; i < monitored.size(); ++i)
+	{
+		if (CaseMap::equals(monitored[i], nick))
+			return (false);
+	}
+	monitored.push_back(nick);
+	return (true);
+}
+
+bool	Client::removeMonitored(const std::string &nick)
+{
+	for (size_t i = 0; i < monitored.size(); ++i)
+	{
+		if (CaseMap::equals(monitored[i], nick))
+		{
+			monitored[i] = monitored.back();
+			monitored.pop_back();
+			return (true);
+		}
+	}
+	return (false);
 }
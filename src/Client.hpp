@@ -2,22 +2,53 @@
 #define CLIENT_HPP
 
 #include <string>
+#include <vector>
+
+#include "OutputBuffer.hpp"
+#include "IString.hpp"
+#include "MaskSet.hpp"
+
+class Channel;
+
+// IRCv3 capabilities a client can enable with CAP REQ, one bit each
+enum Capability
+{
+	CAP_MESSAGE_TAGS	= 1 << 0,
+	CAP_SERVER_TIME		= 1 << 1,
+	CAP_BATCH			= 1 << 2,
+	CAP_CHATHISTORY		= 1 << 3
+};
 
 class Client
 {
+	public:
+		static const unsigned int	noId = static_cast<unsigned int>(-1);
+
 	private:
-		int			clientFd;
-		std::string	nickname;
-		std::string	username;
-		std::string	hostname;
+		int						clientFd;
+		unsigned int			id;		// Dense server-wide index
+		std::vector<Channel*>	channels;	// Channels this client is in
+		std::vector<Channel*>	invites;	// Channels this client is invited to
+		std::vector<std::string>	monitored;	// MONITOR targets as given
+		IString		nickname;	// Interned: shared with the nick table key
+		IString		username;
+		IString		hostname;	// Interned: clients behind one gateway share it
+		std::string	realname;
+		std::string	prefix;
+		unsigned	prefixVersion;
 		bool		passwordAccepted;
 		bool		authenticated;
 		bool		isInvisible;
-		std::string	buffer;
-		std::string	bufferOut;
+		bool		flushQueued;
+		unsigned	caps;		// Capability bits
+		BufferSegment	*input;		// Partial line, only held while one exists
+		OutputBuffer	bufferOut;
+		mutable MatchCache	matchCache;	// Ban/exception results, see MaskSet
 
 		Client(); // Block default constructor
 
+		void	updatePrefix();
+
 	public:
 		// Constructor
 		Client(int fd);
@@ -27,31 +58,56 @@ class Client
 
 		// Getter
 		int					getClientFd() const;
+		unsigned int		getId() const;
+		const std::vector<Channel*>&	getChannels() const;
+		const std::vector<Channel*>&	getInvites() const;
+		const std::vector<std::string>&	getMonitored() const;
 		const std::string&	getUsername() const;
 		const std::string&	getNickname() const;
 		const std::string&	getHostname() const;
+		const std::string&	getRealname() const;
+		const std::string&	getPrefix() const;
+		unsigned			getPrefixVersion() const;
 		bool				isPasswordAccepted() const;
 		bool				isAuthenticated() const;
 		bool				getIsInvisible() const;
+		bool				isFlushQueued() const;
+		unsigned			getCaps() const;
+		bool				hasCap(Capability cap) const;
 
-		const std::string&	getBuffer() const;
-		std::string&		getBuffer();
+		BufferSegment*		getInput();
+		MatchCache&			getMatchCache() const;
 
-		const std::string&	getBufferOut() const;
-		std::string&		getBufferOut();
+		const OutputBuffer&	getBufferOut() const;
+		OutputBuffer&		getBufferOut();
 
 		// Setter
 		void	setClientFd(int fd);
+		void	setId(unsigned int id);
 		void	setNickname(const std::string &nickname);
 		void	setUsername(const std::string &username);
 		void	setHostname(const std::string &hostname);
+		void	setRealname(const std::string &realname);
 		void	setPasswordAccepted(bool isAccepted);
 		void	setAuthenticated(bool isAuth);
 		void	setIsInvisible(bool isNotVisible);
+		void	setFlushQueued(bool queued);
+		void	setCaps(unsigned caps);
 
 		// Utilities
-		void	appendToBuffer(const std::string &newData);
-		void	appendToBufferOut(const std::string &newData);
+		void	stashInput(const char *data, size_t len);
+		void	releaseInput();
+		size_t	getFootprint() const;
+
+		// Membership index, maintained by Channel
+		void	addChannel(Channel *channel);
+		void	removeChannel(Channel *channel);
+		void	addInvite(Channel *channel);
+		void	removeInvite(Channel *channel);
+
+		// Watch list, maintained by MonitorIndex (false if unchanged)
+		bool	addMonitored(const std::string &nick);
+		bool	removeMonitored(const std::string &nick);
 };
 
 #endif
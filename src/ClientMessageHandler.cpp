@@ -6,53 +6,195 @@
 #include "Utils.hpp"
 #include "config.hpp"
 #include "Bot.hpp"
+#include "ReplyBuilder.hpp"
+#include "Logger.hpp"
+#include "Probes.hpp"
+#include "Arena.hpp"
+#include "CaseMap.hpp"
 
-#include <iostream>
-#include <sstream>
 #include <cstdio>
+#include <algorithm>
+#include <cctype>
 #include <climits>
+#include <cstdlib>
 
-std::map<std::string, CommandHandler>	ClientMessageHandler::commandMap;
+std::map<std::string, ClientMessageHandler::CommandEntry>	ClientMessageHandler::commandMap;
 
 ClientMessageHandler::ModeContext::ModeContext() 
     : server(NULL), channel(NULL), client(NULL), tokens(NULL), paramIndex(0) {}
 
-void	ClientMessageHandler::handleMessage(Server &server, Client &client)
+static Channel::MaskList	maskListFor(char mode)
 {
-	std::string	&buffer = client.getBuffer();
+	if (mode == 'e')
+		return (Channel::EXCEPT_LIST);
+	if (mode == 'I')
+		return (Channel::INVEX_LIST);
+	return (Channel::BAN_LIST);
+}
+
+// Accumulates mode changes into "+it-o nick" form and sends them as one
+// MODE line per serverConfig::maxModeParams parameters
+class ModeBatch
+{
+	private:
+		Server		&server;
+		Channel		*channel;
+		Client		*client;
+		ArenaString	modes;
+		ArenaString	params;
+		char		sign;
+		size_t		paramCount;
+
+		ModeBatch(); // Block default constructor
+
+	public:
+		ModeBatch(Server &server, Channel *channel, Client *client)
+			: server(server), channel(channel), client(client),
+			modes(server.getCommandArena(), 32), params(server.getCommandArena()),
+			sign(0), paramCount(0) {}
+
+		void	add(char newSign, char mode, const StringRef &param = StringRef())
+		{
+			if (!param.empty() && paramCount == serverConfig::maxModeParams)
+				flush();
+			if (newSign != sign)
+			{
+				modes << newSign;
+				sign = newSign;
+			}
+			modes << mode;
+			if (!param.empty())
+			{
+				if (paramCount)
+					params << ' ';
+				params << param;
+				++paramCount;
+			}
+		}
+
+		void	flush()
+		{
+			if (modes.size())
+				server.notifyModeChange(channel, client, modes.ref(), params.ref());
+			modes.clear();
+			params.clear();
+			sign = 0;
+			paramCount = 0;
+		}
+};
+
+// Comma separated nicks under one MONITOR numeric, split into as many
+// lines as needed to stay well under 512 bytes
+class NickBatch
+{
+	private:
+		ReplyBuilder	&rb;
+		const Client	&client;
+		int				code;
+		size_t			lineLen;
+
+		NickBatch(); // Block default constructor
+
+	public:
+		NickBatch(ReplyBuilder &rb, const Client &client, int code)
+			: rb(rb), client(client), code(code), lineLen(0) {}
+
+		void	add(const StringRef &item)
+		{
+			if (lineLen && lineLen + item.size() + 1 > 400)
+				flush();
+			if (!lineLen)
+			{
+				rb << ":" SERVER_NAME " ";
+				rb.numeric(code) << ' ' << client.getNickname() << " :";
+				lineLen = 1;
+			}
+			else
+				rb << ',';
+			rb << item;
+			lineLen += item.size() + 1;
+		}
+
+		void	flush()
+		{
+			if (lineLen)
+				rb << "\r\n";
+			lineLen = 0;
+		}
+};
+
+// Runs every complete line in data and returns how many bytes were used.
+// Lines are tokenized in place: tokens point into the read buffer and any
+// scratch a handler needs comes from the command arena, which is rewound
+// after every command.
+size_t	ClientMessageHandler::handleMessage(Server &server, Client &client,
+			const char *data, size_t len)
+{
+	Arena		&arena = server.getCommandArena();
+	StringRef	input(data, len);
+	size_t		start = 0;
+	size_t		scan = 0;
 	size_t		pos;
 
-	while ((pos = buffer.find("\r\n")) != std::string::npos)
+	while ((pos = input.find('\r', scan)) != StringRef::npos && pos + 1 < len)
 	{
-		std::string line = buffer.substr(0, pos);
-		buffer.erase(0, pos + 2);
+		if (input[pos + 1] != '\n')
+		{
+			scan = pos + 1;
+			continue ;
+		}
+
+		StringRef	line(data + start, pos - start);
 
+		start = pos + 2;
+		scan = start;
 		if (line.empty())
 			continue;
 
-		std::vector<std::string> tokens = tokenize(line);	
-		processCommand(server, client, tokens);
+		TokenList tokens = tokenize(arena, line);
+		processCommand(server, client, tokens, line.size());
+		arena.reset();
 	}
+	return (start);
+}
+
+void	ClientMessageHandler::addCommand(const std::string &name, CommandId id,
+			CommandHandler handler)
+{
+	CommandEntry	entry;
+
+	entry.id = id;
+	entry.handler = handler;
+	commandMap[name] = entry;
 }
 
 void	ClientMessageHandler::initCommandMap()
 {
-	commandMap["PASS"]		= &ClientMessageHandler::handlePass;
-	commandMap["NICK"]		= &ClientMessageHandler::handleNick;
-	commandMap["USER"]		= &ClientMessageHandler::handleUser;
-	commandMap["PRIVMSG"]	= &ClientMessageHandler::handlePrivMsg;
-	commandMap["JOIN"]		= &ClientMessageHandler::handleJoin;
-	commandMap["PART"]		= &ClientMessageHandler::handlePart;
-	commandMap["QUIT"]		= &ClientMessageHandler::handleQuit;
-	commandMap["KICK"]		= &ClientMessageHandler::handleKick;
-	commandMap["INVITE"]	= &ClientMessageHandler::handleInvite;
-	commandMap["TOPIC"]		= &ClientMessageHandler::handleTopic;
-	commandMap["MODE"]		= &ClientMessageHandler::handleMode;
-	commandMap["PING"]		= &ClientMessageHandler::handlePing;
+	addCommand("PASS",		CMD_PASS,		&ClientMessageHandler::handlePass);
+	addCommand("NICK",		CMD_NICK,		&ClientMessageHandler::handleNick);
+	addCommand("USER",		CMD_USER,		&ClientMessageHandler::handleUser);
+	addCommand("PRIVMSG",	CMD_PRIVMSG,	&ClientMessageHandler::handlePrivMsg);
+	addCommand("NOTICE",	CMD_NOTICE,		&ClientMessageHandler::handleNotice);
+	addCommand("WHO",		CMD_WHO,		&ClientMessageHandler::handleWho);
+	addCommand("WHOIS",		CMD_WHOIS,		&ClientMessageHandler::handleWhois);
+	addCommand("LIST",		CMD_LIST,		&ClientMessageHandler::handleList);
+	addCommand("MONITOR",	CMD_MONITOR,	&ClientMessageHandler::handleMonitor);
+	addCommand("CAP",		CMD_CAP,		&ClientMessageHandler::handleCap);
+	addCommand("CHATHISTORY", CMD_CHATHISTORY, &ClientMessageHandler::handleChatHistory);
+	addCommand("JOIN",		CMD_JOIN,		&ClientMessageHandler::handleJoin);
+	addCommand("PART",		CMD_PART,		&ClientMessageHandler::handlePart);
+	addCommand("QUIT",		CMD_QUIT,		&ClientMessageHandler::handleQuit);
+	addCommand("KICK",		CMD_KICK,		&ClientMessageHandler::handleKick);
+	addCommand("INVITE",	CMD_INVITE,		&ClientMessageHandler::handleInvite);
+	addCommand("TOPIC",		CMD_TOPIC,		&ClientMessageHandler::handleTopic);
+	addCommand("MODE",		CMD_MODE,		&ClientMessageHandler::handleMode);
+	addCommand("PING",		CMD_PING,		&ClientMessageHandler::handlePing);
+	addCommand("STATS",		CMD_STATS,		&ClientMessageHandler::handleStats);
+	addCommand("NAMES",		CMD_NAMES,		&ClientMessageHandler::handleNames);
 }
 
 void	ClientMessageHandler::processCommand(Server &server, Client &client,
-			const std::vector<std::string> &tokens)
+			const TokenList &tokens, size_t lineLen)
 {
 	if (commandMap.empty())
 	{
@@ -61,24 +203,116 @@ void	ClientMessageHandler::processCommand(Server &server, Client &client,
 
 	if (!tokens.empty())
 	{
-		std::map<std::string, CommandHandler>::iterator it;
-		it = commandMap.find(tokens[0]);
+		std::map<std::string, CommandEntry>::iterator it;
+		it = commandMap.find(tokens[0].str()); // Short names stay in SSO
 
 		if (it != commandMap.end())
 		{
-			it->second(server, client, tokens);
+			PROBE_COMMAND(client.getClientFd(), it->second.id, lineLen);
+			it->second.handler(server, client, tokens);
 		}
-		else if (tokens[0] != "CAP" && tokens[0] != "WHO")
+		else
 		{
+			PROBE_COMMAND(client.getClientFd(), CMD_UNKNOWN, lineLen);
 			server.sendNumeric(
 				&client, ERR_UNKNOWNCOMMAND, tokens[0] + " :Unknown command");
 		}
 	}
+	(void)lineLen;
+}
+
+// ------------- CAP -----------//
+
+static const struct
+{
+	const char	*name;
+	Capability	bit;
+}	capabilities[] =
+{
+	{ "batch",				CAP_BATCH },
+	{ "draft/chathistory",	CAP_CHATHISTORY },
+	{ "message-tags",		CAP_MESSAGE_TAGS },
+	{ "server-time",		CAP_SERVER_TIME }
+};
+
+static const size_t	capabilityCount = sizeof(capabilities) / sizeof(capabilities[0]);
+
+// CAP LS | LIST | REQ :<caps> | END. Negotiation never holds registration
+// back: the capabilities only change how CHATHISTORY replies are tagged.
+void	ClientMessageHandler::handleCap(
+			Server &server, Client &client, const TokenList &tokens)
+{
+	const StringRef	&sub = tokens[1];
+
+	if (sub == "END")
+		return ;
+
+	OutputBuffer *out = server.beginReply(&client);
+
+	if (!out)
+		return ;
+
+	ReplyBuilder	rb(*out, client.getClientFd());
+	StringRef		target = client.getNickname().empty() ? StringRef("*")
+						: StringRef(client.getNickname());
+
+	if (sub == "LS" || sub == "LIST")
+	{
+		bool	first = true;
+
+		rb << ":" SERVER_NAME " CAP " << target << ' ' << sub << " :";
+		for (size_t i = 0; i < capabilityCount; ++i)
+		{
+			if (sub == "LIST" && !client.hasCap(capabilities[i].bit))
+				continue ;
+			if (!first)
+				rb << ' ';
+			rb << StringRef(capabilities[i].name);
+			first = false;
+		}
+		rb << "\r\n";
+	}
+	else if (sub == "REQ")
+	{
+		TokenList	wanted = TokenList::split(server.getCommandArena(), tokens[2], ' ');
+		unsigned	caps = client.getCaps();
+		bool		known = true;
+
+		for (size_t i = 0; i < wanted.size() && known; ++i)
+		{
+			StringRef	name = wanted[i];
+			bool		remove = !name.empty() && name[0] == '-';
+			size_t		c = 0;
+
+			if (name.empty())
+				continue ;
+			if (remove)
+				name = name.substr(1);
+			while (c < capabilityCount && name != capabilities[c].name)
+				++c;
+			if (c == capabilityCount)
+				known = false;
+			else if (remove)
+				caps &= ~static_cast<unsigned>(capabilities[c].bit);
+			else
+				caps |= capabilities[c].bit;
+		}
+		if (known)
+			client.setCaps(caps);
+		rb << ":" SERVER_NAME " CAP " << target << (known ? " ACK :" : " NAK :")
+			<< tokens[2] << "\r\n";
+	}
+	else
+	{
+		rb << ":" SERVER_NAME " ";
+		rb.numeric(ERR_INVALIDCAPCMD) << ' ' << target << ' ' << sub
+			<< " :Invalid CAP command\r\n";
+	}
 }
 
 // ------------- PASS -----------//
 void	ClientMessageHandler::handlePass(
-			Server &server, Client &client, const std::vector<std::string> &tokens)
+			Server &server, Client &client, const TokenList &tokens)
 {
 	if (client.isPasswordAccepted())
 		return ;
@@ -102,44 +336,41 @@ void	ClientMessageHandler::handlePass(
 
 // ------------- NICK -----------//
 void	ClientMessageHandler::handleNick(
-			Server &server, Client &client, const std::vector<std::string> &tokens)
+			Server &server, Client &client, const TokenList &tokens)
 {
-	if (!client.getNickname().empty())
-		return ;
-
-	if (tokens.size() == 1)
+	if (tokens.size() == 1 || tokens[1].empty())
 	{
 		server.sendNumeric(&client, ERR_NONICKNAMEGIVEN, ":No nickname given");
 	}
-	else if (tokens[1].at(0) == '#')
+	else if (!isValidNickname(tokens[1]))
 	{
 		server.sendNumeric(
 			&client, ERR_ERRONEUSNICKNAME,  tokens[1] + " :Erroneus nickname");
 	}
+	else if (client.isAuthenticated())
+	{
+		if (!server.changeNickname(&client, tokens[1].str()))
+		{
+			server.sendNumeric(&client, ERR_NICKNAMEINUSE,
+				tokens[1] + " :Nickname is already in use");
+		}
+	}
 	else
 	{
-		std::map<std::string, Client*>	clientsByNick;
-		
-		clientsByNick = server.getClientsByNick();
-		for (std::map<std::string, Client*>::iterator it
-				= clientsByNick.begin();
-				it != clientsByNick.end(); ++it)
+		if (!server.claimNickname(&client, tokens[1].str()))
 		{
-			if (it->second->getNickname() == client.getNickname())
-			{
-				server.sendError(&client, "Nickname already in use");
-				return ;
-			}
+			server.sendNumeric(&client, ERR_NICKNAMEINUSE,
+				tokens[1] + " :Nickname is already in use");
+			return ;
 		}
 
-		client.setNickname(tokens[1]);
 		server.authenticateClient(&client);
 	}
 }
 
 // ------------- USER -----------//
 void	ClientMessageHandler::handleUser(
-			Server &server, Client &client, const std::vector<std::string> &tokens)
+			Server &server, Client &client, const TokenList &tokens)
 {
 	if (!client.getUsername().empty())
 		return ;
@@ -150,100 +381,199 @@ void	ClientMessageHandler::handleUser(
 	}
 	else
 	{
-		client.setUsername(tokens[1]);
+		client.setUsername(tokens[1].str());
 
 		if (tokens.size() >= 3)
-			client.setHostname(tokens[2]);
+			client.setHostname(tokens[2].str());
 		else
 			client.setHostname("*");
+		if (tokens.size() >= 5 && !tokens[4].empty())
+			client.setRealname(tokens[4].str());
+		else
+			client.setRealname(tokens[1].str());
 		server.authenticateClient(&client);
 	}
 }
 
-// ------------- PRIVMSG -----------//
+// ------------- PRIVMSG / NOTICE -----------//
 void	ClientMessageHandler::handlePrivMsg(
-			Server &server, Client &client, const std::vector<std::string> &tokens)
+			Server &server, Client &client, const TokenList &tokens)
+{
+	relayMessage(server, client, tokens, false);
+}
+
+void	ClientMessageHandler::handleNotice(
+			Server &server, Client &client, const TokenList &tokens)
+{
+	relayMessage(server, client, tokens, true);
+}
+
+// Delivers to every comma separated target (up to maxTargets). The
+// ":prefix COMMAND " head and " :text" tail are rendered once; each
+// target only adds its own name in between. A target named twice is
+// served once. NOTICE never produces error replies or bot answers.
+void	ClientMessageHandler::relayMessage(Server &server, Client &client,
+			const TokenList &tokens, bool notice)
 {
+	const char	*command = notice ? "NOTICE" : "PRIVMSG";
+
 	if (!client.isAuthenticated())
 	{
-		server.sendNumeric(&client, ERR_NOTREGISTERED, ":You have not registered");
+		if (!notice)
+			server.sendNumeric(&client, ERR_NOTREGISTERED, ":You have not registered");
 		return ;
 	}
 
-	if (tokens.size() != 3)
+	if (tokens[1].empty())
 	{
-		server.sendNumeric(
-			&client, ERR_NEEDMOREPARAMS, "PRIVMSG :Not enough parameters");
-		return;
+		if (!notice)
+			server.sendNumeric(&client, ERR_NORECIPIENT,
+				"No recipient given (" + std::string(command) + ")");
+		return ;
 	}
-	
-	if (tokens[1][0] == '#')
+
+	if (tokens.size() < 3 || tokens[2].empty())
+	{
+		if (!notice)
+			server.sendNumeric(&client, ERR_NOTEXTTOSEND, "No text to send");
+		return ;
+	}
+
+	Arena		&arena = server.getCommandArena();
+	TokenList	targets = TokenList::split(arena, tokens[1], ',');
+	ArenaString	head(arena);
+	ArenaString	tail(arena, tokens[2].size() + 4);
+	const void	**seen = arena.allocArray<const void*>(targets.size());
+	size_t		seenCount = 0;
+	size_t		named = 0;	// Non-empty targets, counted against maxTargets
+	IString		source;		// Shared by every channel's history record
+	IString		payload;
+
+	ContentFilter::Match	verdict;
+
+	head << client.getPrefix() << ' ' << StringRef(command) << ' ';
+	tail << " :" << tokens[2] << "\r\n";
+
+	// The text is the same for every target: scan it once, before anything
+	// is delivered, so a KILL never leaves part of the fanout done
+	verdict.action = ContentFilter::NONE;
+	verdict.pattern = NULL;
+	for (size_t i = 0; i < targets.size(); ++i)
+	{
+		if (!targets[i].empty() && targets[i][0] == '#')
+		{
+			verdict = server.getContentFilter().scan(tokens[2]);
+			break ;
+		}
+	}
+	if (verdict.action == ContentFilter::KILL)
+		server.disconnectClient(&client, "Content filter");
+
+	for (size_t i = 0; i < targets.size(); ++i)
 	{
-		std::map<std::string, Channel*> channels = server.getChannels();
-		std::map<std::string, Channel*>::iterator it = channels.find(tokens[1]);
+		const StringRef	&name = targets[i];
+
+		if (name.empty())
+			continue ;
+
+		if (++named > serverConfig::maxTargets)
+		{
+			if (!notice)
+				server.sendNumeric(&client, ERR_TOOMANYTARGETS,
+					name + " :Too many recipients");
+			continue ;
+		}
+
+		Channel		*channel = NULL;
+		Client		*target = NULL;
+		const void	*key;
+
+		if (name[0] == '#')
+			key = channel = server.findChannel(name);
+		else
+			key = target = server.findClient(name);
+
+		if (!key)
+		{
+			if (notice)
+				continue ;
+			if (name[0] == '#')
+				server.sendNumeric(&client, ERR_NOSUCHCHANNEL, name + " :No such channel");
+			else
+				server.sendNumeric(&client, ERR_NOSUCHNICK, name + " :No such nick");
+			continue ;
+		}
+
+		if (std::find(seen, seen + seenCount, key) != seen + seenCount)
+			continue ;
+		seen[seenCount++] = key;
+
+		const std::string	&canonical = channel ? channel->getName()
+													: target->getNickname();
+		ArenaString			wire(arena, head.size() + canonical.size() + tail.size());
 
-		if (it != channels.end())
+		wire << head.ref() << canonical << tail.ref();
+
+		if (channel)
 		{
-			Channel 	*channel = it->second;
+			if (!channel->hasMember(&client))
+			{
+				if (!notice)
+					server.sendNumeric(&client, ERR_NOTONCHANNEL,
+						channel->getName() + " :You're not on that channel");
+				continue ;
+			}
 
-			const std::map<std::string, const Client*>& users = channel->getUsers();
+			if (channel->isBanned(&client) && !channel->isOperator(&client))
+			{
+				if (!notice)
+					server.sendNumeric(&client, ERR_CANNOTSENDTOCHAN,
+						channel->getName() + " :Cannot send to channel");
+				continue ;
+			}
 
-			if (users.find(client.getNickname()) == users.end())
+			if (verdict.action == ContentFilter::DROP)
+				continue ;
+			if (verdict.action == ContentFilter::NOTIFY)
 			{
-				server.sendNumeric(&client, ERR_NOTONCHANNEL,
-					channel->getName() + " :You're not on that channel");
-				return ;
+				server.noticeOperators(channel, "Filter: " + client.getNickname()
+					+ " matched \"" + *verdict.pattern + "\" in " + channel->getName());
 			}
 
-			for (std::map<std::string, const Client*>::const_iterator i = users.begin();
-				i != users.end(); ++i)
+			server.broadcast(channel, wire.ref(), &client);
+
+			if (payload.empty())
 			{
-				if (i->second != &client)
-					server.sendPrivMsg(&client, tokens[1] ,i->second, tokens[2]);
+				source = IString(client.getPrefix());
+				payload = IString(tokens[2].data(), tokens[2].size());
 			}
+			server.recordHistory(channel,
+				notice ? HistoryStore::NOTICE : HistoryStore::PRIVMSG, source, payload);
 
 			// Send advice to Bot
-			if (server.getBot())
+			if (!notice && server.getBot()
+				&& channel->hasMember(server.getBot()->getIdentityBot()))
 			{
-				const Client* botId = server.getBot()->getIdentityBot();
-				if (users.find(botId->getNickname()) != users.end())
-				{
-					server.getBot()->onChannelMessage(it->second, &client, tokens[2]);
-				}
+				server.getBot()->onChannelMessage(channel, &client, tokens[2]);
 			}
 		}
 		else
 		{
-			server.sendNumeric(
-				&client, ERR_NOSUCHCHANNEL, tokens[1] + " :No such channel");
-		}
-	}
-	else
-	{
-		std::map<std::string, Client*> clients = server.getClientsByNick();
-		std::map<std::string, Client*>::iterator it = clients.find(tokens[1]);
-
-		if (it != clients.end())
-		{
-			if (it->second != &client)
-				server.sendPrivMsg(&client, it->second->getNickname() ,it->second, tokens[2]);
+			if (target != &client)
+				server.deliver(target, wire.ref());
 			// If it's the Bot, make a response
-            if (server.getBot() && it->second == server.getBot()->getIdentityBot())
+			if (!notice && server.getBot()
+				&& target == server.getBot()->getIdentityBot())
 			{
-                server.getBot()->onDirectMessage(&client, tokens[2]);
-            }
-		}
-		else
-		{
-			server.sendNumeric(
-				&client, ERR_NOSUCHNICK, tokens[1] + " :No such nick");
+				server.getBot()->onDirectMessage(&client, tokens[2].str());
+			}
 		}
 	}
 }
 
 // ------------- JOIN -----------//
 void	ClientMessageHandler::handleJoin(
-			Server &server, Client &client, const std::vector<std::string> &tokens)
+			Server &server, Client &client, const TokenList &tokens)
 {
 	if (!client.isAuthenticated())
 	{
@@ -257,32 +587,48 @@ void	ClientMessageHandler::handleJoin(
 		return;
 	}
 	
-	std::vector<std::string>	channelsToJoin;
-	std::vector<std::string>	keys;
+	Arena		&arena = server.getCommandArena();
+	TokenList	channelsToJoin = TokenList::split(arena, tokens[1], ',');
+	TokenList	keys = TokenList::split(arena, tokens[2], ',');
 
-	channelsToJoin = Utils::split(tokens[1], ',');
-	if (tokens.size() > 2)
-		keys = Utils::split(tokens[2], ',');
-
-	std::map<std::string, Channel*> channels = server.getChannels();
-	
 	for (size_t i = 0; i < channelsToJoin.size(); ++i)
 	{
-		std::map<std::string, Channel*>::iterator it = channels.find(channelsToJoin[i]);
+		Channel *channel = server.findChannel(channelsToJoin[i]);
+
+		if (channel && channel->hasMember(&client))
+			continue ;
+
+		if (client.getChannels().size() >= serverConfig::maxChannelsPerUser)
+		{
+			server.sendNumeric(&client, ERR_TOOMANYCHANNELS,
+				channelsToJoin[i] + " :You have joined too many channels");
+			continue ;
+		}
 
-		if (it != channels.end())
+		// First JOIN creates the channel; addUser() makes the creator operator
+		if (!channel && isValidChannelName(channelsToJoin[i]))
 		{
-			Channel 	*channel = it->second;
-			std::string userList;
+			channel = server.createChannel(channelsToJoin[i].str());
+			if (!channel)
+			{
+				server.sendNumeric(&client, ERR_UNAVAILRESOURCE, channelsToJoin[i]
+					+ " :Nick/channel is temporarily unavailable");
+				continue ;
+			}
+		}
 
-			const std::map<std::string, const Client*>& users 	= channel->getUsers();
-			const std::set<const Client*>& operators 			= channel->getOperators();
-			const std::set<const Client*>& invited 				= channel->getInvited();
+		if (channel)
+		{
 
-			if (users.find(client.getNickname()) != users.end())
+			if (channel->isBanned(&client) && !channel->isInvited(&client))
+			{
+				server.sendNumeric(&client, ERR_BANNEDFROMCHAN,
+									channelsToJoin[i] + " :Cannot join channel (+b)");
 				continue ;
+			}
 
-			if (channel->isInviteOnly() && invited.find(&client) == invited.end())
+			if (channel->isInviteOnly() && !channel->isInvited(&client)
+				&& !channel->isInviteExempt(&client))
 			{
 				server.sendNumeric(&client, ERR_INVITEONLYCHAN,
 									channelsToJoin[i] + " :Cannot join channel (+i)");
@@ -300,38 +646,23 @@ void	ClientMessageHandler::handleJoin(
 			}
 			
 			if (channel->getUserLimit() > -1
-				&& channel->getUsers().size() >= static_cast<size_t>(channel->getUserLimit()))
+				&& channel->getMemberCount() >= static_cast<size_t>(channel->getUserLimit()))
 			{
 				server.sendNumeric(&client, ERR_CHANNELISFULL,
 									channelsToJoin[i] + " :Cannot join channel (+l)");
 				continue ;
 			}
 
-			for (std::map<std::string, const Client*>::const_iterator ui = users.begin();
-				ui != users.end(); ++ui)
-			{
-				if (!userList.empty())
-					userList += " ";
-				if (operators.find(ui->second) != operators.end())
-					userList += "@";
-				userList += ui->second->getNickname();
-			}
-
-			server.sendNameReply(&client, channelsToJoin[i], userList);
-			server.sendEndOfNames(&client, channelsToJoin[i]);
-
 			channel->addUser(&client);
 
-			std::string joinMsg = ":" + client.getNickname() + "!"
-				+ client.getUsername() + "@" + client.getHostname() + " JOIN "
-				+ channelsToJoin[i] + "\r\n";
+			ArenaString wire(arena);
 
-			const std::map<std::string, const Client*>& newUsers = channel->getUsers();
-			for (std::map<std::string, const Client*>::const_iterator ui
-				= newUsers.begin(); ui != newUsers.end(); ++ui)
-			{
-				server.sendRaw(ui->second, joinMsg);
-			}
+			wire << client.getPrefix() << " JOIN " << channel->getName() << "\r\n";
+			server.broadcast(channel, wire.ref());
+			server.recordHistory(channel, HistoryStore::JOIN,
+				IString(client.getPrefix()), IString());
+
+			server.sendNames(&client, channel);
 
 			// Bot notification
 			if (server.getBot())
@@ -349,7 +680,7 @@ void	ClientMessageHandler::handleJoin(
 
 // ------------- PART -----------//
 void	ClientMessageHandler::handlePart(
-			Server &server, Client &client, const std::vector<std::string> &tokens)
+			Server &server, Client &client, const TokenList &tokens)
 {
 	if (!client.isAuthenticated())
 	{
@@ -363,41 +694,35 @@ void	ClientMessageHandler::handlePart(
 		return;
 	}
 	
-	std::vector<std::string>		channelsToLeave = Utils::split(tokens[1], ',');
-	std::map<std::string, Channel*>	channels = server.getChannels();
+	Arena		&arena = server.getCommandArena();
+	TokenList	channelsToLeave = TokenList::split(arena, tokens[1], ',');
 	
 	for (size_t i = 0; i < channelsToLeave.size(); ++i)
 	{
-		std::map<std::string, Channel*>::iterator it = channels.find(channelsToLeave[i]);
+		Channel *channel = server.findChannel(channelsToLeave[i]);
 
-		if (it != channels.end())
+		if (channel)
 		{
-			Channel 	*channel = it->second;
 
-			const std::map<std::string, const Client*>& users = channel->getUsers();
-
-			if (users.find(client.getNickname()) == users.end())
+			if (!channel->hasMember(&client))
 			{
 				server.sendNumeric(&client, ERR_NOTONCHANNEL,
 					channelsToLeave[i] + " :You're not on that channel");
 				continue ;
 			}
 
-			std::string	msg("");
-			if (tokens.size() >= 3)
-				msg = " :" + tokens[2];
+			ArenaString leaveMsg(arena);
 
-			std::string leaveMsg = ":" + client.getNickname() + "!"
-				+ client.getUsername() + "@" + client.getHostname() + " PART "
-				+ channelsToLeave[i] + msg + "\r\n";
-			
-			for (std::map<std::string, const Client*>::const_iterator ui
-				= users.begin(); ui != users.end(); ++ui)
-			{
-				server.sendRaw(ui->second, leaveMsg);
-			}
-			channel->removeUser(client.getNickname());
-			channel->removeOperator(&client);
+			leaveMsg << client.getPrefix() << " PART " << channel->getName();
+			if (tokens.size() >= 3)
+				leaveMsg << " :" << tokens[2];
+			leaveMsg << "\r\n";
+
+			server.broadcast(channel, leaveMsg.ref());
+			server.recordHistory(channel, HistoryStore::PART,
+				IString(client.getPrefix()), IString(tokens[2].data(), tokens[2].size()));
+			channel->removeUser(&client);
+			server.reclaimChannel(channel);
 		}
 		else
 		{
@@ -409,7 +734,7 @@ void	ClientMessageHandler::handlePart(
 
 // ------------- KICK -----------//
 void	ClientMessageHandler::handleKick(
-			Server &server, Client &client, const std::vector<std::string> &tokens)
+			Server &server, Client &client, const TokenList &tokens)
 {
 	if (!client.isAuthenticated())
 	{
@@ -423,45 +748,35 @@ void	ClientMessageHandler::handleKick(
 		return ;
 	}
 	
-	std::map<std::string, Channel*>	channels = server.getChannels();
-	
-	std::map<std::string, Channel*>::iterator it = channels.find(tokens[1]);
+	Channel *channel = server.findChannel(tokens[1]);
 
-	if (it != channels.end())
+	if (channel)
 	{
-		Channel 						*channel = it->second;
-		const std::set<const Client*>	operators = channel->getOperators();
-
-		if (operators.find(&client) == operators.end())
+		if (!channel->isOperator(&client))
 		{
 			server.sendNumeric(&client, ERR_CHANOPRIVSNEEDED, client.getNickname()
 								+ " " + tokens[1] + " :You're not channel operator");
 			return ;
 		}
 
-		const std::map<std::string, const Client*>& users = channel->getUsers();
-		if (users.find(tokens[2]) == users.end())
+		Client *target = server.findClient(tokens[2]);
+		if (!target || !channel->hasMember(target))
 		{
 			server.sendNumeric(&client, ERR_USERNOTINCHANNEL, tokens[2] + " "
 								+ tokens[1] + " :They aren't on that channel");
 			return ;
 		}
 
-		std::string	msg("");
+		ArenaString kickMsg(server.getCommandArena());
+
+		kickMsg << client.getPrefix() << " KICK " << tokens[1] << ' ' << tokens[2];
 		if (tokens.size() >= 4)
-			msg = " :" + tokens[3];
+			kickMsg << " :" << tokens[3];
+		kickMsg << "\r\n";
 
-		std::string kickMsg = ":" + client.getNickname() + "!"
-			+ client.getUsername() + "@" + client.getHostname() + " KICK "
-			+ tokens[1] + " " + tokens[2] + msg + "\r\n";
-			
-		for (std::map<std::string, const Client*>::const_iterator ui
-			= users.begin(); ui != users.end(); ++ui)
-		{
-			server.sendRaw(ui->second, kickMsg);
-		}
-		channel->removeUser(tokens[2]);
-		channel->removeOperator(users.find(tokens[2])->second);
+		server.broadcast(channel, kickMsg.ref());
+		channel->removeUser(target);
+		server.reclaimChannel(channel);
 	}
 	else
 	{
@@ -472,7 +787,7 @@ void	ClientMessageHandler::handleKick(
 
 // ------------- INVITE -----------//
 void	ClientMessageHandler::handleInvite(
-			Server &server, Client &client, const std::vector<std::string> &tokens)
+			Server &server, Client &client, const TokenList &tokens)
 {
 	if (!client.isAuthenticated())
 	{
@@ -486,43 +801,34 @@ void	ClientMessageHandler::handleInvite(
 		return ;
 	}
 	
-	std::map<std::string, Channel*>	channels = server.getChannels();
-	
-	std::map<std::string, Channel*>::iterator it = channels.find(tokens[2]);
+	Channel *channel = server.findChannel(tokens[2]);
 
-	if (it != channels.end())
+	if (channel)
 	{
-		Channel	*channel = it->second;
-	
-		const std::map<std::string, const Client*>& users = channel->getUsers();
-		const std::map<std::string, const Client*>::const_iterator ui
-			= users.find(client.getNickname());
-		const std::set<const Client*> operators= channel->getOperators();
-		
-		if (ui == users.end())
+
+		if (!channel->hasMember(&client))
 		{
 			server.sendNumeric(&client, ERR_NOTONCHANNEL,
 				tokens[1] + " :You're not on that channel");
 			return ;
 		}
 	
-		if (channel->isInviteOnly() && operators.find(&client) == operators.end())
+		if (channel->isInviteOnly() && !channel->isOperator(&client))
 		{
 			server.sendNumeric(&client, ERR_CHANOPRIVSNEEDED, client.getNickname()
 								+ " " + tokens[2] + " :You're not channel operator");
 			return ;
 		}
 		
-		std::map<std::string, Client*> clientsByNick = server.getClientsByNick();
-		std::map<std::string, Client*>::iterator ci = clientsByNick.find(tokens[1]);
-		if (ci == clientsByNick.end())
+		Client *target = server.findClient(tokens[1]);
+		if (!target)
 		{
 			server.sendNumeric(&client, ERR_NOSUCHNICK,
 				tokens[1] + " :No such nick");
 			return ;
 		}
 
-		if (users.find(tokens[1]) != users.end())
+		if (channel->hasMember(target))
 		{
 			server.sendNumeric(&client, ERR_USERONCHANNEL,
 				tokens[1] + " " + tokens[2] + " :Is already on channel");
@@ -531,25 +837,25 @@ void	ClientMessageHandler::handleInvite(
 		}
 
 		// If Bot is invited, make automatic join
-		if (server.getBot() && ci->second == server.getBot()->getIdentityBot())
+		if (server.getBot() && target == server.getBot()->getIdentityBot())
 		{
-			server.getBot()->join(tokens[2]);
+			server.getBot()->join(tokens[2].str());
 			server.sendNumeric(&client, RPL_INVITING,
 				client.getNickname() + " " + tokens[1] + " " + tokens[2]);
 			return;
 		}
 
-		std::string inviteMsg = ":" + client.getNickname() + "!"
-			+ client.getUsername() + "@" + client.getHostname() + " INVITE "
-			+ tokens[1] + " " + tokens[2] + "\r\n";
-			
-		server.sendRaw(ci->second, inviteMsg);
+		ArenaString inviteMsg(server.getCommandArena());
+
+		inviteMsg << client.getPrefix() << " INVITE " << tokens[1] << ' '
+			<< tokens[2] << "\r\n";
+		server.deliver(target, inviteMsg.ref());
 
 		server.sendNumeric(&client, RPL_INVITING, client.getNickname() + " "
 			+ tokens[1] + " " + tokens[2]);
 	
 		if (channel->isInviteOnly())
-			channel->addInvited(ci->second);
+			channel->addInvited(target);
 	}
 	else
 	{
@@ -560,7 +866,7 @@ void	ClientMessageHandler::handleInvite(
 
 // ------------- TOPIC -----------//
 void	ClientMessageHandler::handleTopic(
-			Server &server, Client &client, const std::vector<std::string> &tokens)
+			Server &server, Client &client, const TokenList &tokens)
 {
 	if (!client.isAuthenticated())
 	{
@@ -574,19 +880,11 @@ void	ClientMessageHandler::handleTopic(
 		return ;
 	}
 	
-	std::map<std::string, Channel*>	channels = server.getChannels();	
-	std::map<std::string, Channel*>::iterator it = channels.find(tokens[1]);
+	Channel *channel = server.findChannel(tokens[1]);
 
-	if (it != channels.end())
+	if (channel)
 	{
-		Channel *channel									= it->second;
-		const std::set<const Client*> operators				= channel->getOperators();
-		const std::map<std::string, const Client*>& users	= channel->getUsers();
-
-		std::map<std::string, const Client*>::const_iterator ui 
-			= users.find(client.getNickname());
-
-		if (ui == users.end())
+		if (!channel->hasMember(&client))
 		{
 			server.sendNumeric(&client, ERR_NOTONCHANNEL,
 				tokens[1] + " :You're not on that channel");
@@ -594,7 +892,7 @@ void	ClientMessageHandler::handleTopic(
 		}
 
 		if (tokens.size() > 2 && channel->isTopicBlocked()
-			&& operators.find(&client) == operators.end())
+			&& !channel->isOperator(&client))
 		{
 			server.sendNumeric(&client, ERR_CHANOPRIVSNEEDED, client.getNickname()
 								+ " " + tokens[1] + " :You're not channel operator");
@@ -613,16 +911,15 @@ void	ClientMessageHandler::handleTopic(
 		}
 		else
 		{
-			channel->setTopic(tokens[2]);
+			channel->setTopic(tokens[2].str());
 
-			std::string topicMsg = ":" + client.getNickname() + "!"
-				+ client.getUsername() + "@" + client.getHostname() + " TOPIC "
-				+ tokens[1] + " :" + tokens[2] + "\r\n";
-			
-			for (ui = users.begin(); ui != users.end(); ++ui)
-			{
-				server.sendRaw(ui->second, topicMsg);
-			}
+			ArenaString topicMsg(server.getCommandArena());
+
+			topicMsg << client.getPrefix() << " TOPIC " << tokens[1] << " :"
+				<< tokens[2] << "\r\n";
+			server.broadcast(channel, topicMsg.ref());
+			server.recordHistory(channel, HistoryStore::TOPIC,
+				IString(client.getPrefix()), IString(channel->getTopic()));
 		}
 	}
 	else
@@ -634,22 +931,27 @@ void	ClientMessageHandler::handleTopic(
 
 // ------------- QUIT -----------//
 void	ClientMessageHandler::handleQuit(
-			Server &server, Client &client, const std::vector<std::string> &tokens)
+			Server &server, Client &client, const TokenList &tokens)
 {
-	server.disconnectClient(&client, "Goodbye");
-	(void)tokens;
+	if (tokens.size() > 1 && !tokens[1].empty())
+		server.disconnectClient(&client, "Quit: " + tokens[1].str());
+	else
+		server.disconnectClient(&client, "Client Quit");
 }
 
 // ------------- PING -----------//
 void	ClientMessageHandler::handlePing(
-			Server &server, Client &client, const std::vector<std::string> &tokens)
+			Server &server, Client &client, const TokenList &tokens)
 {
-	server.sendRaw(&client, std::string("PONG :" + tokens[1]));
+	ArenaString pong(server.getCommandArena(), 64);
+
+	pong << "PONG :" << tokens[1];
+	server.sendRaw(&client, pong.ref());
 }
 
-// ------------- MODE -----------//
-void ClientMessageHandler::handleMode(
-	Server &server, Client &client, const std::vector<std::string> &tokens)
+// ------------- STATS -----------//
+void	ClientMessageHandler::handleStats(
+			Server &server, Client &client, const TokenList &tokens)
 {
 	if (!client.isAuthenticated())
 	{
@@ -659,98 +961,801 @@ void ClientMessageHandler::handleMode(
 
 	if (tokens.size() < 2)
 	{
-		server.sendNumeric(&client, ERR_NEEDMOREPARAMS, "MODE :Not enough parameters");
+		server.sendNumeric(&client, ERR_NEEDMOREPARAMS, "STATS :Not enough parameters");
 		return ;
 	}
 
-	if (tokens[1][0] != '#')
+	server.sendStats(&client, tokens[1]);
+}
+
+// ------------- NAMES -----------//
+// Channels are all public here, so any existing channel is listed.
+// A bare NAMES only gets the end marker rather than every channel.
+void	ClientMessageHandler::handleNames(
+			Server &server, Client &client, const TokenList &tokens)
+{
+	if (!client.isAuthenticated())
 	{
+		server.sendNumeric(&client, ERR_NOTREGISTERED, ":You have not registered");
 		return ;
 	}
 
-	std::map<std::string, Channel*> channels = server.getChannels();
-	std::map<std::string, Channel*>::iterator it = channels.find(tokens[1]);
-
-	if (it == channels.end())
+	if (tokens.size() < 2)
 	{
-		server.sendNumeric(&client, ERR_NOSUCHCHANNEL, tokens[1] + " :No such channel");
+		server.sendEndOfNames(&client, "*");
 		return ;
 	}
 
-	Channel *channel									= it->second;
-	const std::set<const Client*> operators				= channel->getOperators();
-	const std::map<std::string, const Client*>& users	= channel->getUsers();
+	TokenList	targets = TokenList::split(server.getCommandArena(), tokens[1], ',');
 
-	std::map<std::string, const Client*>::const_iterator ui 
-		= users.find(client.getNickname());
-
-	if (ui == users.end())
+	for (size_t i = 0; i < targets.size(); ++i)
 	{
-		server.sendNumeric(&client, ERR_NOTONCHANNEL,
-			tokens[1] + " :You're not on that channel");
-			return ;
+		Channel *channel = server.findChannel(targets[i]);
+
+		if (channel)
+			server.sendNames(&client, channel);
+		else
+			server.sendEndOfNames(&client, targets[i]);
 	}
+}
 
-	//Current channel modes
-	bool	inviteOnly		= channel->isInviteOnly();
-	bool	topicBlocked	= channel->isTopicBlocked();
-	bool	keyChannel		= !channel->getKey().empty();
-	bool	userLimit		= channel->getUserLimit() > 0;
+// ------------- WHO / WHOIS -----------//
 
-	// If channel exist ask for mode
-	if (tokens.size() == 2)
+// True when a and b are together in at least one channel
+static bool	sharesChannel(const Client *a, const Client *b)
+{
+	if (a->getChannels().size() > b->getChannels().size())
+		std::swap(a, b);
+
+	const std::vector<Channel*> &joined = a->getChannels();
+
+	for (size_t i = 0; i < joined.size(); ++i)
 	{
-		// TODO separar en función
-		std::string	mode = "+";
-		std::string	params;
-		if (inviteOnly) mode += "i";
-		if (topicBlocked) mode += "t";
-		if (keyChannel)
-		{
-			mode += "k";
-			params += " " + channel->getKey();
-		}
-		if (userLimit)
-		{
-			mode += "l";
-			params += " " + Utils::toString(channel->getUserLimit());
-		}
+		if (joined[i]->hasMember(b))
+			return (true);
+	}
+	return (false);
+}
 
-		std::string msg = ":" + serverConfig::serverName + " 324 "
-                  + client.getNickname() + " "
-                  + tokens[1] + " "
-                  + mode;
-		if (!params.empty())
-			msg += " " + params;
-		msg += "\r\n";
+// Invisible (+i) users are only listed to themselves and to their peers
+static bool	isVisibleTo(const Client *user, const Client *viewer)
+{
+	return (!user->getIsInvisible() || user == viewer || sharesChannel(user, viewer));
+}
 
-		server.sendRaw(&client, msg);
+static bool	hasWildcard(const StringRef &mask)
+{
+	return (mask.find('*') != StringRef::npos || mask.find('?') != StringRef::npos);
+}
 
-		// -----------------------------
+static void	appendWhoReply(ReplyBuilder &rb, const Client &client, const Client *user,
+				const StringRef &channel, bool isOperator)
+{
+	rb << ":" SERVER_NAME " ";
+	rb.numeric(RPL_WHOREPLY) << ' ' << client.getNickname() << ' ' << channel << ' '
+		<< user->getUsername() << ' ' << user->getHostname() << " " SERVER_NAME " "
+		<< user->getNickname() << " H";
+	if (isOperator)
+		rb << '@';
+	rb << " :0 " << user->getRealname() << "\r\n";
+}
 
+// Matches are written to the output buffer as the index is walked, the
+// result set is never collected. A nick mask only visits the index range
+// of its literal prefix ("ab" for "ab*", everything for "*!*@host").
+void	ClientMessageHandler::handleWho(
+			Server &server, Client &client, const TokenList &tokens)
+{
+	if (!client.isAuthenticated())
+	{
+		server.sendNumeric(&client, ERR_NOTREGISTERED, ":You have not registered");
 		return ;
 	}
 
-	// Check if the cliente is a channel operator
-	if (channel->getOperators().find(&client) == channel->getOperators().end())
-	{
-		server.sendNumeric(&client, ERR_CHANOPRIVSNEEDED,
-			tokens[1] + " :You're not channel operator");
-		
+	StringRef		mask = tokens[1].empty() ? StringRef("*") : tokens[1];
+	OutputBuffer	*out = server.beginReply(&client);
+
+	if (!out)
 		return ;
-	}
 
-	//Generate a valid chain "+-+it--k+ol-"
-	std::string execCmd;
-	std::string flagsAccepted = "itkol";
-	char currentSign = 0;
-	for (size_t i = 0; i < tokens[2].size(); ++i)
+	ReplyBuilder	rb(*out, client.getClientFd());
+
+	if (mask[0] == '#')
 	{
-		char c = tokens[2][i];
-		if (c == '+' || c == '-')
+		const Channel *channel = server.findChannel(mask);
+
+		if (channel)
 		{
-			currentSign = c;
-			execCmd += c;
+			const Channel::Member	*members = channel->getMembers().data();
+			size_t					count = channel->getMembers().size();
+			bool					inside = channel->hasMember(&client);
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				const Client *user = server.getClientById(members[i].id);
+
+				if (!user || (!inside && user->getIsInvisible()))
+					continue ;
+				appendWhoReply(rb, client, user, StringRef(channel->getName()),
+					members[i].roles & Channel::ROLE_OPERATOR);
+			}
+		}
+	}
+	else
+	{
+		std::string	folded = CaseMap::fold(mask.str());
+
+		if (folded == "0")
+			folded = "*";
+
+		size_t		nickEnd = folded.find_first_of("!@");
+		bool		full = (nickEnd != std::string::npos);
+		std::string	prefix = folded.substr(0,
+						std::min(nickEnd, folded.find_first_of("*?")));
+
+		if (full)
+			folded = MaskSet::normalize(folded);
+
+		const NickIndex	&index = server.getNickIndex();
+
+		for (NickIndex::const_iterator it = index.lowerBound(prefix);
+			it != index.end() && NickIndex::inRange(it, prefix); ++it)
+		{
+			const Client		*user = it->second;
+
+			if (!user->isAuthenticated())
+				continue ;
+
+			const std::string	&subject = full
+				? user->getMatchCache().foldedSubject(*user) : it->first;
+
+			if (MaskSet::matchMask(folded, subject) && isVisibleTo(user, &client))
+				appendWhoReply(rb, client, user, StringRef("*"), false);
+		}
+	}
+
+	rb << ":" SERVER_NAME " ";
+	rb.numeric(RPL_ENDOFWHO) << ' ' << client.getNickname() << ' ' << mask
+		<< " :End of WHO list\r\n";
+}
+
+void	ClientMessageHandler::handleWhois(
+			Server &server, Client &client, const TokenList &tokens)
+{
+	if (!client.isAuthenticated())
+	{
+		server.sendNumeric(&client, ERR_NOTREGISTERED, ":You have not registered");
+		return ;
+	}
+
+	// "WHOIS <server> <nick>" is answered locally as well
+	const StringRef	&query = tokens.size() > 2 ? tokens[2] : tokens[1];
+
+	if (query.empty())
+	{
+		server.sendNumeric(&client, ERR_NONICKNAMEGIVEN, "No nickname given");
+		return ;
+	}
+
+	TokenList	targets = TokenList::split(server.getCommandArena(), query, ',');
+
+	for (size_t i = 0; i < targets.size() && i < serverConfig::maxTargets; ++i)
+	{
+		const StringRef	&name = targets[i];
+		bool			found = false;
+
+		if (hasWildcard(name))
+		{
+			std::string		folded = CaseMap::fold(name.str());
+			std::string		prefix = folded.substr(0, folded.find_first_of("*?"));
+			const NickIndex	&index = server.getNickIndex();
+
+			for (NickIndex::const_iterator it = index.lowerBound(prefix);
+				it != index.end() && NickIndex::inRange(it, prefix); ++it)
+			{
+				const Client *user = it->second;
+
+				if (user->isAuthenticated() && isVisibleTo(user, &client)
+					&& MaskSet::matchMask(folded, it->first))
+				{
+					sendWhois(server, client, user);
+					found = true;
+				}
+			}
+		}
+		else
+		{
+			const Client *user = server.findClient(name);
+
+			if (user && user->isAuthenticated())
+			{
+				sendWhois(server, client, user);
+				found = true;
+			}
+		}
+		if (!found)
+			server.sendNumeric(&client, ERR_NOSUCHNICK, name + " :No such nick");
+	}
+
+	OutputBuffer *out = server.beginReply(&client);
+
+	if (!out)
+		return ;
+
+	ReplyBuilder	rb(*out, client.getClientFd());
+
+	rb << ":" SERVER_NAME " ";
+	rb.numeric(RPL_ENDOFWHOIS) << ' ' << client.getNickname() << ' ' << query
+		<< " :End of /WHOIS list\r\n";
+}
+
+// RPL_WHOISUSER, RPL_WHOISCHANNELS (split to stay under 512 bytes) and
+// RPL_WHOISSERVER for one user
+void	ClientMessageHandler::sendWhois(Server &server, Client &client,
+			const Client *user)
+{
+	OutputBuffer *out = server.beginReply(&client);
+
+	if (!out)
+		return ;
+
+	ReplyBuilder	rb(*out, client.getClientFd());
+
+	rb << ":" SERVER_NAME " ";
+	rb.numeric(RPL_WHOISUSER) << ' ' << client.getNickname() << ' '
+		<< user->getNickname() << ' ' << user->getUsername() << ' '
+		<< user->getHostname() << " * :" << user->getRealname() << "\r\n";
+
+	const std::vector<Channel*>	&joined = user->getChannels();
+	size_t						lineLen = 0;
+
+	for (size_t i = 0; i < joined.size(); ++i)
+	{
+		const std::string &name = joined[i]->getName();
+
+		if (lineLen && lineLen + name.size() + 2 > 400)
+		{
+			rb << "\r\n";
+			lineLen = 0;
+		}
+		if (!lineLen)
+		{
+			rb << ":" SERVER_NAME " ";
+			rb.numeric(RPL_WHOISCHANNELS) << ' ' << client.getNickname() << ' '
+				<< user->getNickname() << " :";
+			lineLen = 1;
+		}
+		else
+			rb << ' ';
+		if (joined[i]->isOperator(user))
+			rb << '@';
+		rb << name;
+		lineLen += name.size() + 2;
+	}
+	if (lineLen)
+		rb << "\r\n";
+
+	rb << ":" SERVER_NAME " ";
+	rb.numeric(RPL_WHOISSERVER) << ' ' << client.getNickname() << ' '
+		<< user->getNickname() << " " SERVER_NAME " :" SERVER_VERSION "\r\n";
+}
+
+// ------------- MONITOR -----------//
+
+// MONITOR + targets | - targets | C | L | S
+void	ClientMessageHandler::handleMonitor(
+			Server &server, Client &client, const TokenList &tokens)
+{
+	if (!client.isAuthenticated())
+	{
+		server.sendNumeric(&client, ERR_NOTREGISTERED, ":You have not registered");
+		return ;
+	}
+
+	const StringRef	&op = tokens[1];
+	char			sub = op.size() == 1 ? op[0] : 0;
+
+	if (!sub || ((sub == '+' || sub == '-') && tokens[2].empty()))
+	{
+		server.sendNumeric(&client, ERR_NEEDMOREPARAMS, "MONITOR :Not enough parameters");
+		return ;
+	}
+
+	Arena			&arena = server.getCommandArena();
+	MonitorIndex	&monitors = server.getMonitors();
+
+	if (sub == '+' || sub == '-')
+	{
+		TokenList	targets = TokenList::split(arena, tokens[2], ',');
+		TokenList	added(arena, targets.size());
+		size_t		i;
+
+		for (i = 0; i < targets.size(); ++i)
+		{
+			if (targets[i].empty())
+				continue ;
+			if (sub == '-')
+				monitors.remove(&client, targets[i].str());
+			else if (client.getMonitored().size() >= serverConfig::maxMonitor)
+				break ;
+			else if (monitors.add(&client, targets[i].str()))
+				added.push_back(targets[i]);
+		}
+		if (sub == '-')
+			return ;
+		sendMonitorStatus(server, client, added);
+		if (i == targets.size())
+			return ;
+
+		OutputBuffer *out = server.beginReply(&client);
+
+		if (!out)
+			return ;
+
+		ReplyBuilder	rb(*out, client.getClientFd());
+		const StringRef	&list = tokens[2];
+		size_t			offset = static_cast<size_t>(targets[i].data() - list.data());
+
+		rb << ":" SERVER_NAME " ";
+		rb.numeric(ERR_MONLISTFULL) << ' ' << client.getNickname() << ' '
+			<< serverConfig::maxMonitor << ' ' << list.substr(offset)
+			<< " :Monitor list is full\r\n";
+	}
+	else if (sub == 'C' || sub == 'c')
+		monitors.removeAll(&client);
+	else if (sub == 'L' || sub == 'l')
+	{
+		OutputBuffer *out = server.beginReply(&client);
+
+		if (!out)
+			return ;
+
+		ReplyBuilder	rb(*out, client.getClientFd());
+		NickBatch		batch(rb, client, RPL_MONLIST);
+		const std::vector<std::string>	&watched = client.getMonitored();
+
+		for (size_t i = 0; i < watched.size(); ++i)
+			batch.add(watched[i]);
+		batch.flush();
+		rb << ":" SERVER_NAME " ";
+		rb.numeric(RPL_ENDOFMONLIST) << ' ' << client.getNickname()
+			<< " :End of MONITOR list\r\n";
+	}
+	else if (sub == 'S' || sub == 's')
+	{
+		const std::vector<std::string>	&watched = client.getMonitored();
+		TokenList						nicks(arena, watched.size());
+
+		for (size_t i = 0; i < watched.size(); ++i)
+			nicks.push_back(watched[i]);
+		sendMonitorStatus(server, client, nicks);
+	}
+}
+
+// RPL_MONONLINE for the nicks in use, then RPL_MONOFFLINE for the rest
+void	ClientMessageHandler::sendMonitorStatus(Server &server, Client &client,
+			const TokenList &nicks)
+{
+	if (nicks.empty())
+		return ;
+
+	OutputBuffer *out = server.beginReply(&client);
+
+	if (!out)
+		return ;
+
+	ReplyBuilder	rb(*out, client.getClientFd());
+	NickBatch		online(rb, client, RPL_MONONLINE);
+
+	for (size_t i = 0; i < nicks.size(); ++i)
+	{
+		const Client *user = server.findClient(nicks[i]);
+
+		if (user && user->isAuthenticated())
+		{
+			const std::string &prefix = user->getPrefix();
+
+			online.add(StringRef(prefix.data() + 1, prefix.size() - 1));
+		}
+	}
+	online.flush();
+
+	NickBatch		offline(rb, client, RPL_MONOFFLINE);
+
+	for (size_t i = 0; i < nicks.size(); ++i)
+	{
+		const Client *user = server.findClient(nicks[i]);
+
+		if (!user || !user->isAuthenticated())
+			offline.add(nicks[i]);
+	}
+	offline.flush();
+}
+
+// ------------- CHATHISTORY -----------//
+
+static void	failChatHistory(Server &server, Client &client, const char *code,
+				const StringRef &context, const char *text)
+{
+	OutputBuffer *out = server.beginReply(&client);
+
+	if (!out)
+		return ;
+	ReplyBuilder(*out, client.getClientFd()) << ":" SERVER_NAME " FAIL CHATHISTORY "
+		<< StringRef(code) << ' ' << context << " :" << StringRef(text) << "\r\n";
+}
+
+// "msgid=<id>" or "timestamp=<server-time>"
+static bool	parseAnchor(const StringRef &text, HistoryStore::Anchor &anchor)
+{
+	if (text.size() > 6 && text.substr(0, 6) == "msgid=")
+	{
+		std::string	digits = text.substr(6).str();
+		char		*end;
+
+		anchor.byTime = false;
+		anchor.value = std::strtoul(digits.c_str(), &end, 10);
+		return (*end == '\0');
+	}
+	if (text.size() > 10 && text.substr(0, 10) == "timestamp=")
+	{
+		anchor.byTime = true;
+		return (Utils::parseServerTime(text.substr(10).str(), anchor.value));
+	}
+	return (false);
+}
+
+// CHATHISTORY LATEST <channel> <*|ref> <limit>
+// CHATHISTORY BEFORE|AFTER <channel> <ref> <limit>
+void	ClientMessageHandler::handleChatHistory(
+			Server &server, Client &client, const TokenList &tokens)
+{
+	if (!client.isAuthenticated())
+	{
+		server.sendNumeric(&client, ERR_NOTREGISTERED, ":You have not registered");
+		return ;
+	}
+
+	if (tokens[4].empty())
+	{
+		server.sendNumeric(&client, ERR_NEEDMOREPARAMS,
+			"CHATHISTORY :Not enough parameters");
+		return ;
+	}
+
+	const StringRef	&sub = tokens[1];
+	Channel			*channel = server.findChannel(tokens[2]);
+
+	if (sub != "LATEST" && sub != "BEFORE" && sub != "AFTER")
+	{
+		failChatHistory(server, client, "INVALID_PARAMS", sub, "Unknown subcommand");
+		return ;
+	}
+	if (!channel || !channel->hasMember(&client))
+	{
+		ArenaString context(server.getCommandArena());
+
+		context << sub << ' ' << tokens[2];
+		failChatHistory(server, client, "INVALID_TARGET", context.ref(),
+			"Messages could not be retrieved");
+		return ;
+	}
+
+	HistoryStore::Anchor	anchor;
+	bool					anchored = parseAnchor(tokens[3], anchor);
+	std::string				limitText = tokens[4].str();
+	char					*limitEnd;
+	size_t					limit = std::strtoul(limitText.c_str(), &limitEnd, 10);
+
+	if (!anchored && (sub != "LATEST" || tokens[3] != "*"))
+	{
+		failChatHistory(server, client, "INVALID_PARAMS", sub, "Invalid message reference");
+		return ;
+	}
+	if (limitText.empty() || !std::isdigit(static_cast<unsigned char>(limitText[0]))
+		|| *limitEnd != '\0' || !limit)
+	{
+		failChatHistory(server, client, "INVALID_PARAMS", sub, "Invalid limit");
+		return ;
+	}
+	if (limit > serverConfig::historyQueryLimit)
+		limit = serverConfig::historyQueryLimit;
+
+	// The ring holds the newest records; older ones come from the disk
+	// log, read only for the part of the range the ring cannot serve
+	const HistoryStore							&history = server.getHistory();
+	const MessageLog							&log = server.getMessageLog();
+	std::vector<const HistoryStore::Record*>	recent;
+	std::vector<HistoryStore::Record>			stored;
+
+	if (sub == "AFTER" && !history.covers(channel, anchor))
+	{
+		log.after(channel->getName(), anchor, limit, stored);
+		if (stored.size() < limit)
+		{
+			HistoryStore::Anchor	last = { false, 0 };
+
+			if (!stored.empty())
+				last.value = stored.back().id;
+			history.after(channel, stored.empty() ? anchor : last,
+				limit - stored.size(), recent);
+		}
+	}
+	else if (sub == "AFTER")
+		history.after(channel, anchor, limit, recent);
+	else
+	{
+		if (sub == "LATEST")
+			history.latest(channel, anchored ? &anchor : NULL, limit, recent);
+		else
+			history.before(channel, anchor, limit, recent);
+
+		if (recent.size() < limit)
+		{
+			HistoryStore::Anchor	edge = { false, ULONG_MAX };
+
+			if (!recent.empty())
+				edge.value = recent.front()->id;
+			else if (sub == "BEFORE")
+				edge = anchor;
+			log.before(channel->getName(), edge, limit - recent.size(), stored);
+
+			// LATEST with a reference stops there
+			while (anchored && sub == "LATEST" && !stored.empty()
+				&& (anchor.byTime ? stored.front().time : stored.front().id)
+					<= anchor.value)
+				stored.erase(stored.begin());
+		}
+	}
+
+	std::vector<const HistoryStore::Record*>	records;
+
+	records.reserve(stored.size() + recent.size());
+	for (size_t i = 0; i < stored.size(); ++i)
+		records.push_back(&stored[i]);
+	records.insert(records.end(), recent.begin(), recent.end());
+	sendHistory(server, client, channel, records);
+}
+
+// Replays records as the original lines, inside a chathistory batch and
+// with time/msgid tags for the capabilities the client enabled
+void	ClientMessageHandler::sendHistory(Server &server, Client &client,
+			const Channel *channel,
+			const std::vector<const HistoryStore::Record*> &records)
+{
+	static unsigned long	batches = 0;
+
+	OutputBuffer *out = server.beginReply(&client);
+
+	if (!out)
+		return ;
+
+	ReplyBuilder	rb(*out, client.getClientFd());
+	bool			batch = client.hasCap(CAP_BATCH);
+	bool			stamps = client.hasCap(CAP_SERVER_TIME);
+	bool			ids = client.hasCap(CAP_MESSAGE_TAGS);
+	char			ref[24];
+
+	std::snprintf(ref, sizeof(ref), "h%lu", ++batches);
+	if (batch)
+		rb << ":" SERVER_NAME " BATCH +" << StringRef(ref) << " chathistory "
+			<< channel->getName() << "\r\n";
+
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		const HistoryStore::Record	&r = *records[i];
+		char						sep = '@';
+
+		if (batch)
+		{
+			rb << sep << "batch=" << StringRef(ref);
+			sep = ';';
+		}
+		if (stamps)
+		{
+			rb << sep << "time=" << Utils::formatServerTime(r.time);
+			sep = ';';
+		}
+		if (ids)
+		{
+			rb << sep << "msgid=" << r.id;
+			sep = ';';
+		}
+		if (sep == ';')
+			rb << ' ';
+		rb << r.source.str() << ' ' << StringRef(HistoryStore::kindName(r.kind))
+			<< ' ' << channel->getName();
+		if (r.kind != HistoryStore::JOIN
+			&& (r.kind != HistoryStore::PART || !r.text.empty()))
+			rb << " :" << r.text.str();
+		rb << "\r\n";
+	}
+
+	if (batch)
+		rb << ":" SERVER_NAME " BATCH -" << StringRef(ref) << "\r\n";
+}
+
+// ------------- LIST -----------//
+
+// LIST [<item>{,<item>}] where an item is ">N" / "<N" (member count),
+// "T=<text>" (topic contains text), a name mask, or exact channel names.
+// Exact names are answered at once; anything else becomes a paced walk
+// over the channel size index (see Server::continueListings).
+void	ClientMessageHandler::handleList(
+			Server &server, Client &client, const TokenList &tokens)
+{
+	if (!client.isAuthenticated())
+	{
+		server.sendNumeric(&client, ERR_NOTREGISTERED, ":You have not registered");
+		return ;
+	}
+
+	Arena				&arena = server.getCommandArena();
+	TokenList			items = TokenList::split(arena, tokens[1], ',');
+	TokenList			names(arena, items.size());
+	ChannelIndex::Query	query;
+
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		const StringRef &item = items[i];
+
+		if (item.size() > 1 && (item[0] == '>' || item[0] == '<'))
+		{
+			int bound = parseUserLimit(item.substr(1));
+
+			if (bound == -1)
+				continue ;
+			if (item[0] == '>')
+				query.minUsers = static_cast<size_t>(bound);
+			else
+				query.maxUsers = static_cast<size_t>(bound);
+		}
+		else if (item.size() > 2 && item[0] == 'T' && item[1] == '=')
+			query.topic = CaseMap::fold(item.substr(2).str());
+		else if (hasWildcard(item))
+			query.mask = CaseMap::fold(item.str());
+		else if (!item.empty())
+			names.push_back(item);
+	}
+
+	OutputBuffer *out = server.beginReply(&client);
+
+	if (!out)
+		return ;
+
+	ReplyBuilder	rb(*out, client.getClientFd());
+
+	rb << ":" SERVER_NAME " ";
+	rb.numeric(RPL_LISTSTART) << ' ' << client.getNickname()
+		<< " Channel :Users  Name\r\n";
+
+	if (names.empty())
+	{
+		server.startListing(&client, query);
+		return ;
+	}
+
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		const Channel *channel = server.findChannel(names[i]);
+
+		if (!channel)
+			continue ;
+		rb << ":" SERVER_NAME " ";
+		rb.numeric(RPL_LIST) << ' ' << client.getNickname() << ' '
+			<< channel->getName() << ' ' << channel->getMemberCount() << " :"
+			<< channel->getTopic() << "\r\n";
+	}
+	rb << ":" SERVER_NAME " ";
+	rb.numeric(RPL_LISTEND) << ' ' << client.getNickname() << " :End of /LIST\r\n";
+}
+
+// ------------- MODE -----------//
+void ClientMessageHandler::handleMode(
+	Server &server, Client &client, const TokenList &tokens)
+{
+	if (!client.isAuthenticated())
+	{
+		server.sendNumeric(&client, ERR_NOTREGISTERED, ":You have not registered");
+		return ;
+	}
+
+	if (tokens.size() < 2)
+	{
+		server.sendNumeric(&client, ERR_NEEDMOREPARAMS, "MODE :Not enough parameters");
+		return ;
+	}
+
+	if (tokens[1][0] != '#')
+	{
+		handleUserMode(server, client, tokens);
+		return ;
+	}
+
+	Channel *channel = server.findChannel(tokens[1]);
+
+	if (!channel)
+	{
+		server.sendNumeric(&client, ERR_NOSUCHCHANNEL, tokens[1] + " :No such channel");
+		return ;
+	}
+
+	if (!channel->hasMember(&client))
+	{
+		server.sendNumeric(&client, ERR_NOTONCHANNEL,
+			tokens[1] + " :You're not on that channel");
+			return ;
+	}
+
+	//Current channel modes
+	bool	inviteOnly		= channel->isInviteOnly();
+	bool	topicBlocked	= channel->isTopicBlocked();
+	bool	keyChannel		= !channel->getKey().empty();
+	bool	userLimit		= channel->getUserLimit() > 0;
+	std::string	key			= channel->getKey();
+	int		limit			= channel->getUserLimit();
+
+	// If channel exist ask for mode
+	if (tokens.size() == 2)
+	{
+		OutputBuffer *out = server.beginReply(&client);
+		if (!out)
+			return ;
+
+		ReplyBuilder rb(*out, client.getClientFd());
+
+		rb << ":" SERVER_NAME " ";
+		rb.numeric(RPL_CHANNELMODEIS) << ' ' << client.getNickname() << ' '
+			<< tokens[1] << " +";
+		if (inviteOnly) rb << 'i';
+		if (topicBlocked) rb << 't';
+		if (keyChannel) rb << 'k';
+		if (userLimit) rb << 'l';
+		if (keyChannel)
+			rb << ' ' << channel->getKey();
+		if (userLimit)
+			rb << ' ' << channel->getUserLimit();
+		rb << "\r\n";
+
+		return ;
+	}
+
+	// "MODE #c b" (or +b, -e, ...) only lists, anyone on the channel may ask
+	if (tokens.size() == 3)
+	{
+		StringRef	flags = tokens[2];
+		size_t		pos = 0;
+
+		while (pos < flags.size() && (flags[pos] == '+' || flags[pos] == '-'))
+			++pos;
+		if (pos + 1 == flags.size()
+			&& (flags[pos] == 'b' || flags[pos] == 'e' || flags[pos] == 'I'))
+		{
+			sendMaskList(server, client, channel, flags[pos]);
+			return ;
+		}
+	}
+
+	// Check if the cliente is a channel operator
+	if (!channel->isOperator(&client))
+	{
+		server.sendNumeric(&client, ERR_CHANOPRIVSNEEDED,
+			tokens[1] + " :You're not channel operator");
+		
+		return ;
+	}
+
+	//Generate a valid chain "+-+it--k+ol-"
+	std::string execCmd;
+	std::string flagsAccepted = "itkolbeI";
+	char currentSign = 0;
+	for (size_t i = 0; i < tokens[2].size(); ++i)
+	{
+		char c = tokens[2][i];
+		if (c == '+' || c == '-')
+		{
+			currentSign = c;
+			execCmd += c;
 			continue ;
 		}
 
@@ -781,9 +1786,229 @@ void ClientMessageHandler::handleMode(
 		changeMode(execCmd[i], currentSign, modeCtx);	
 	}
 
-	// TODO Print last message (only changes from original state)
+	// Each edited mask list is compiled once, whatever the number of masks
+	for (std::map<char, MaskEdit>::iterator it = modeCtx.maskEdits.begin();
+		it != modeCtx.maskEdits.end(); ++it)
+	{
+		std::vector<std::string>	masks;
+
+		masks.reserve(it->second.masks.size());
+		for (std::map<std::string, std::string>::iterator m = it->second.masks.begin();
+			m != it->second.masks.end(); ++m)
+			masks.push_back(m->second);
+		channel->setMaskList(maskListFor(it->first), masks);
+	}
 
+	// Announce only the net effect of the whole string, in merged lines
+	ModeBatch	batch(server, channel, &client);
+	std::string	limitText;
+
+	for (size_t i = 0; i < modeCtx.touched.size(); ++i)
+	{
+		const ModeTouch &touch = modeCtx.touched[i];
+
+		switch (touch.mode)
+		{
+			case 'i':
+				if (channel->isInviteOnly() != inviteOnly)
+					batch.add(inviteOnly ? '-' : '+', 'i');
+				break;
+
+			case 't':
+				if (channel->isTopicBlocked() != topicBlocked)
+					batch.add(topicBlocked ? '-' : '+', 't');
+				break;
+
+			case 'k':
+				if (channel->getKey() == key)
+					break;
+				if (!key.empty())
+					batch.add('-', 'k', StringRef(key));
+				if (!channel->getKey().empty())
+					batch.add('+', 'k', StringRef(channel->getKey()));
+				break;
+
+			case 'l':
+				if (channel->getUserLimit() == limit)
+					break;
+				if (channel->getUserLimit() > 0)
+				{
+					limitText = Utils::toString(channel->getUserLimit());
+					batch.add('+', 'l', StringRef(limitText));
+				}
+				else
+					batch.add('-', 'l');
+				break;
 
+			case 'o':
+			{
+				bool isOp = channel->isOperator(touch.target);
+
+				if (isOp != touch.wasSet)
+					batch.add(isOp ? '+' : '-', 'o',
+						StringRef(touch.target->getNickname()));
+				break;
+			}
+
+			case 'b':
+			case 'e':
+			case 'I':
+			{
+				const MaskSet	*set = channel->getMaskList(maskListFor(touch.mode));
+				bool			isSet = set && set->contains(touch.mask);
+
+				if (isSet != touch.wasSet)
+					batch.add(isSet ? '+' : '-', touch.mode, StringRef(touch.mask));
+				break;
+			}
+		}
+	}
+	batch.flush();
+}
+
+// MODE <nick> [+i|-i]: only the user's own modes can be read or changed
+void	ClientMessageHandler::handleUserMode(
+			Server &server, Client &client, const TokenList &tokens)
+{
+	const Client *target = server.findClient(tokens[1]);
+
+	if (!target)
+	{
+		server.sendNumeric(&client, ERR_NOSUCHNICK, tokens[1] + " :No such nick");
+		return ;
+	}
+	if (target != &client)
+	{
+		server.sendNumeric(&client, ERR_USERSDONTMATCH, "Cant change mode for other users");
+		return ;
+	}
+
+	if (tokens.size() == 2)
+	{
+		OutputBuffer *out = server.beginReply(&client);
+
+		if (!out)
+			return ;
+
+		ReplyBuilder	rb(*out, client.getClientFd());
+
+		rb << ":" SERVER_NAME " ";
+		rb.numeric(RPL_UMODEIS) << ' ' << client.getNickname() << " +";
+		if (client.getIsInvisible())
+			rb << 'i';
+		rb << "\r\n";
+		return ;
+	}
+
+	const StringRef	&flags = tokens[2];
+	bool			invisible = client.getIsInvisible();
+	bool			unknown = false;
+	char			sign = 0;
+
+	for (size_t i = 0; i < flags.size(); ++i)
+	{
+		if (flags[i] == '+' || flags[i] == '-')
+			sign = flags[i];
+		else if (flags[i] == 'i' && sign)
+			invisible = (sign == '+');
+		else
+			unknown = true;
+	}
+	if (unknown)
+		server.sendNumeric(&client, ERR_UMODEUNKOWNFLAG, "Unknown MODE flag");
+
+	if (invisible != client.getIsInvisible())
+	{
+		ArenaString	wire(server.getCommandArena(), 64);
+
+		client.setIsInvisible(invisible);
+		wire << client.getPrefix() << " MODE " << client.getNickname() << " :"
+			<< (invisible ? StringRef("+i") : StringRef("-i")) << "\r\n";
+		server.deliver(&client, wire.ref());
+	}
+}
+
+// The staged copy of a +b/+e/+I list, seeded from the channel on first use
+ClientMessageHandler::MaskEdit&	ClientMessageHandler::stageMasks(
+			ModeContext &modeCtx, char mode)
+{
+	std::map<char, MaskEdit>::iterator	it = modeCtx.maskEdits.find(mode);
+
+	if (it != modeCtx.maskEdits.end())
+		return (it->second);
+
+	MaskEdit		&edit = modeCtx.maskEdits[mode];
+	const MaskSet	*set = modeCtx.channel->getMaskList(maskListFor(mode));
+
+	if (set)
+	{
+		const std::vector<std::string> &masks = set->getMasks();
+
+		for (size_t i = 0; i < masks.size(); ++i)
+			edit.masks[CaseMap::fold(masks[i])] = masks[i];
+	}
+	return (edit);
+}
+
+// Records the first change of a mode (or of one target's 'o') so the net
+// delta can be computed once the whole mode string has been applied
+void	ClientMessageHandler::touchMode(ModeContext &modeCtx, char mode,
+			const Client *target, bool wasSet, const std::string &mask)
+{
+	for (size_t i = 0; i < modeCtx.touched.size(); ++i)
+	{
+		if (modeCtx.touched[i].mode == mode && modeCtx.touched[i].target == target
+			&& CaseMap::equals(modeCtx.touched[i].mask, mask))
+			return ;
+	}
+
+	ModeTouch	touch;
+
+	touch.mode = mode;
+	touch.target = target;
+	touch.wasSet = wasSet;
+	touch.mask = mask;
+	modeCtx.touched.push_back(touch);
+}
+
+// RPL_BANLIST / RPL_EXCEPTLIST / RPL_INVITELIST and the matching end line
+void	ClientMessageHandler::sendMaskList(Server &server, Client &client,
+			const Channel *channel, char mode)
+{
+	OutputBuffer *out = server.beginReply(&client);
+
+	if (!out)
+		return ;
+
+	int			entry = RPL_BANLIST;
+	int			end = RPL_ENDOFBANLIST;
+	const char	*what = "ban";
+
+	if (mode == 'e')
+	{
+		entry = RPL_EXCEPTLIST;
+		end = RPL_ENDOFEXCEPTLIST;
+		what = "exception";
+	}
+	else if (mode == 'I')
+	{
+		entry = RPL_INVITELIST;
+		end = RPL_ENDOFINVITELIST;
+		what = "invite";
+	}
+
+	const MaskSet	*set = channel->getMaskList(maskListFor(mode));
+	ReplyBuilder	rb(*out, client.getClientFd());
+
+	for (size_t i = 0; set && i < set->size(); ++i)
+	{
+		rb << ":" SERVER_NAME " ";
+		rb.numeric(entry) << ' ' << client.getNickname() << ' '
+			<< channel->getName() << ' ' << set->getMasks()[i] << "\r\n";
+	}
+	rb << ":" SERVER_NAME " ";
+	rb.numeric(end) << ' ' << client.getNickname() << ' ' << channel->getName()
+		<< " :End of channel " << StringRef(what) << " list\r\n";
 }
 
 void	ClientMessageHandler::changeMode(char mode, char symbol, ModeContext &modeCtx)
@@ -795,12 +2020,12 @@ void	ClientMessageHandler::changeMode(char mode, char symbol, ModeContext &modeC
 			if (symbol == '+' && !modeCtx.channel->isInviteOnly())
 			{
 				modeCtx.channel->setInviteOnly(true);
-				modeCtx.server->notifyModeChange(modeCtx.channel, modeCtx.client, "+i");
+				touchMode(modeCtx, 'i');
 			}
 			else if (symbol == '-' && modeCtx.channel->isInviteOnly())
 			{
 				modeCtx.channel->setInviteOnly(false);
-				modeCtx.server->notifyModeChange(modeCtx.channel, modeCtx.client, "-i");
+				touchMode(modeCtx, 'i');
 			}
 			break;
 		}
@@ -815,9 +2040,8 @@ void	ClientMessageHandler::changeMode(char mode, char symbol, ModeContext &modeC
 
 			if (symbol == '+' && modeCtx.channel->getKey().empty())
 			{
-				modeCtx.channel->setKey((*modeCtx.tokens)[modeCtx.paramIndex]);
-				modeCtx.server->notifyModeChange(
-					modeCtx.channel, modeCtx.client, "+k", (*modeCtx.tokens)[modeCtx.paramIndex]);
+				modeCtx.channel->setKey((*modeCtx.tokens)[modeCtx.paramIndex].str());
+				touchMode(modeCtx, 'k');
 			}
 			else if (symbol == '+')
 			{
@@ -830,7 +2054,7 @@ void	ClientMessageHandler::changeMode(char mode, char symbol, ModeContext &modeC
 				if (modeCtx.channel->getKey() == (*modeCtx.tokens)[modeCtx.paramIndex])
 				{
 					modeCtx.channel->setKey("");
-					modeCtx.server->notifyModeChange(modeCtx.channel, modeCtx.client, "-k");
+					touchMode(modeCtx, 'k');
 				}
 			}
 			++(modeCtx.paramIndex);
@@ -843,12 +2067,12 @@ void	ClientMessageHandler::changeMode(char mode, char symbol, ModeContext &modeC
 			if (symbol == '+' && !modeCtx.channel->isTopicBlocked())
 			{
 				modeCtx.channel->setTopicBlocked(true);
-				modeCtx.server->notifyModeChange(modeCtx.channel, modeCtx.client, "+t");
+				touchMode(modeCtx, 't');
 			}
 			else if (symbol == '-' && modeCtx.channel->isTopicBlocked())
 			{
 				modeCtx.channel->setTopicBlocked(false);
-				modeCtx.server->notifyModeChange(modeCtx.channel, modeCtx.client, "-t");
+				touchMode(modeCtx, 't');
 			}
 			break;
 		}
@@ -860,11 +2084,10 @@ void	ClientMessageHandler::changeMode(char mode, char symbol, ModeContext &modeC
 				return ;
 			}
 
-			std::string	userName = (*modeCtx.tokens)[modeCtx.paramIndex];
-			std::map<std::string, const Client*> users = modeCtx.channel->getUsers();
-			std::map<std::string, const Client*>::iterator ui = users.find(userName);
+			const StringRef	&userName = (*modeCtx.tokens)[modeCtx.paramIndex];
+			const Client *user = modeCtx.server->findClient(userName);
 			
-			if (ui == users.end())
+			if (!user || !modeCtx.channel->hasMember(user))
 			{
 				modeCtx.server->sendNumeric(modeCtx.client, ERR_USERNOTINCHANNEL, userName
 						+ " " + modeCtx.channel->getName() + " :They aren't on that channel");
@@ -873,20 +2096,18 @@ void	ClientMessageHandler::changeMode(char mode, char symbol, ModeContext &modeC
 				return ;
 			}
 
-			const Client *user = ui->second;
-			std::set<const Client*> currentOp		= modeCtx.channel->getOperators();
-			std::set<const Client*>::iterator oi	= currentOp.find(user);
+			bool isOp = modeCtx.channel->isOperator(user);
 			
-			if (symbol == '+' && oi == currentOp.end())
+			if (symbol == '+' && !isOp)
 			{
+				touchMode(modeCtx, 'o', user, isOp);
 				modeCtx.channel->addOperator(user);
-				modeCtx.server->notifyModeChange(modeCtx.channel, modeCtx.client, "+o", userName);
 			}
-			else if (symbol == '-' && oi != currentOp.end())
+			else if (symbol == '-' && isOp)
 
 			{
+				touchMode(modeCtx, 'o', user, isOp);
 				modeCtx.channel->removeOperator(user);
-				modeCtx.server->notifyModeChange(modeCtx.channel, modeCtx.client, "-o", userName);
 			}
 
 			++(modeCtx.paramIndex);
@@ -894,33 +2115,66 @@ void	ClientMessageHandler::changeMode(char mode, char symbol, ModeContext &modeC
 			break;
 		}
 
-		case 'l':
+		case 'b':
+		case 'e':
+		case 'I':
 		{
-			if ((*modeCtx.tokens).size() <= modeCtx.paramIndex)
+			if (modeCtx.tokens->size() <= modeCtx.paramIndex)
 			{
-				modeCtx.server->sendNumeric(modeCtx.client, ERR_NEEDMOREPARAMS,
-									"MODE :Not enough parameters");
+				sendMaskList(*modeCtx.server, *modeCtx.client, modeCtx.channel, mode);
 				return ;
 			}
 
-			const std::string &extra = (*modeCtx.tokens)[modeCtx.paramIndex];
+			MaskEdit	&edit = stageMasks(modeCtx, mode);
+			std::string	mask = MaskSet::normalize(
+							(*modeCtx.tokens)[modeCtx.paramIndex].str());
+			std::string	folded = CaseMap::fold(mask);
+			bool		isSet = edit.masks.count(folded) != 0;
+
+			++(modeCtx.paramIndex);
+			if (symbol == '+' && !isSet)
+			{
+				if (edit.masks.size() >= serverConfig::maxListEntries)
+				{
+					modeCtx.server->sendNumeric(modeCtx.client, ERR_BANLISTFULL,
+						modeCtx.channel->getName() + " " + mode + " :Channel list is full");
+					return ;
+				}
+				touchMode(modeCtx, mode, NULL, false, mask);
+				edit.masks[folded] = mask;
+			}
+			else if (symbol == '-' && isSet)
+			{
+				touchMode(modeCtx, mode, NULL, true, mask);
+				edit.masks.erase(folded);
+			}
+			break;
+		}
 
+		case 'l':
+		{
 			if (symbol == '+')
 			{
+				if ((*modeCtx.tokens).size() <= modeCtx.paramIndex)
+				{
+					modeCtx.server->sendNumeric(modeCtx.client, ERR_NEEDMOREPARAMS,
+										"MODE :Not enough parameters");
+					return ;
+				}
+
 				int	newLimit = parseUserLimit((*modeCtx.tokens)[modeCtx.paramIndex]);
 				if (newLimit != -1)
 				{
 					modeCtx.channel->setUserLimit(newLimit);
-					modeCtx.server->notifyModeChange(modeCtx.channel, modeCtx.client,
-												"+l", extra);
+					touchMode(modeCtx, 'l');
 				
 					++(modeCtx.paramIndex);
 				}
 			}
-			else
+			else if (modeCtx.channel->getUserLimit() > 0)
 			{
 				modeCtx.channel->setUserLimit(-1);
-				modeCtx.server->notifyModeChange(modeCtx.channel, modeCtx.client, "-l");
+				touchMode(modeCtx, 'l');
 			}
 	
 			break;
@@ -929,19 +2183,33 @@ void	ClientMessageHandler::changeMode(char mode, char symbol, ModeContext &modeC
 	}
 }
 
-int	ClientMessageHandler::parseUserLimit(const std::string &param)
+int	ClientMessageHandler::parseUserLimit(const StringRef &param)
 {
 	if (param.empty())
 		return (-1);
 
-	std::istringstream	iss(param);
-	long				value;
-	iss >> value;
+	size_t	i = 0;
+	bool	negative = false;
+	long	value = 0;
 
-	if (iss.fail() || !iss.eof())
+	if (param[0] == '+' || param[0] == '-')
+	{
+		negative = (param[0] == '-');
+		++i;
+	}
+	if (i == param.size())
 		return (-1);
 
-	if (value <= 0 || value > INT_MAX)
+	for (; i < param.size(); ++i)
+	{
+		if (!std::isdigit(static_cast<unsigned char>(param[i])))
+			return (-1);
+		value = value * 10 + (param[i] - '0');
+		if (value > INT_MAX)
+			return (-1);
+	}
+
+	if (negative || value == 0)
         return (-1);
 
 	return (static_cast<int>(value));
@@ -949,36 +2217,87 @@ int	ClientMessageHandler::parseUserLimit(const std::string &param)
 
 
 // Testing tokenizer, printing tokens
-void	ClientMessageHandler::printTokens(const std::vector<std::string> &tokens)
+void	ClientMessageHandler::printTokens(const TokenList &tokens)
 {
+	std::string	line;
+
 	for (size_t i = 0; i < tokens.size(); ++i)
 	{
-		std::cout << "Token " << i << ": '" << tokens[i] << "'" << std::endl;
+		line += "Token " + Utils::toString(static_cast<int>(i)) + ": '"
+			+ tokens[i] + "' ";
 	}
+	LOG_DEBUG(line);
 }
 
-std::vector<std::string>	ClientMessageHandler::tokenize(std::string &line)
+// "#name": 1 to channelNameLen chars after the '#', no comma, space or ^G
+bool	ClientMessageHandler::isValidChannelName(const StringRef &name)
 {
-	std::vector<std::string> tokens;
+	if (name.size() < 2 || name.size() > serverConfig::channelNameLen
+		|| name[0] != '#')
+		return (false);
 
-	size_t	pos = line.find(":");
+	for (size_t i = 1; i < name.size(); ++i)
+	{
+		if (name[i] == ',' || name[i] == ' ' || name[i] == '\a')
+			return (false);
+	}
+	return (true);
+}
 
-	if (pos != std::string::npos)
+// 1 to nickLen chars, not starting with a digit, '-' or '#', and none of
+// the characters masks, target lists and prefixes give a meaning to
+bool	ClientMessageHandler::isValidNickname(const StringRef &nick)
+{
+	if (nick.empty() || nick.size() > serverConfig::nickLen
+		|| nick[0] == '#' || nick[0] == '-'
+		|| std::isdigit(static_cast<unsigned char>(nick[0])))
+		return (false);
+
+	for (size_t i = 0; i < nick.size(); ++i)
 	{
-		std::string			left = line.substr(0, pos);
-		std::string			right = line.substr(pos + 1);
-		
-		tokens = Utils::splitBySpace(left);
+		unsigned char c = static_cast<unsigned char>(nick[i]);
 
-		tokens.push_back(Utils::trim(right));
+		if (c <= ' ' || c == 127 || c == '*' || c == '?' || c == ','
+			|| c == '!' || c == '@' || c == ':')
+			return (false);
 	}
-	else
+	return (true);
+}
+
+// "CMD a b :trailing text" -> CMD, a, b, "trailing text". Everything
+// before the first ':' that starts a word is split on whitespace, the
+// rest is one token (a ':' inside a word, as in a timestamp, is kept).
+TokenList	ClientMessageHandler::tokenize(Arena &arena, const StringRef &line)
+{
+	TokenList	tokens(arena, 16);
+	size_t		pos = line.find(':');
+
+	while (pos != StringRef::npos && pos > 0
+		&& !std::isspace(static_cast<unsigned char>(line[pos - 1])))
+		pos = line.find(':', pos + 1);
+
+	StringRef	left = line.substr(0, pos);
+	size_t		i = 0;
+
+	while (i < left.size())
 	{
-		tokens = Utils::splitBySpace(line);	
+		while (i < left.size() && std::isspace(static_cast<unsigned char>(left[i])))
+			++i;
+
+		size_t	start = i;
+
+		while (i < left.size() && !std::isspace(static_cast<unsigned char>(left[i])))
+			++i;
+		if (i > start)
+			tokens.push_back(left.substr(start, i - start));
 	}
 
-	//TODO DEBUG
+	if (pos != StringRef::npos)
+		tokens.push_back(line.substr(pos + 1).trim());
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
 	printTokens(tokens);
+#endif
 
 	return (tokens);
 }
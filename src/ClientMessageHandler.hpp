@@ -1,79 +1,173 @@
 #ifndef CLIENTMESSAGEHANDLER_HPP
 #define CLIENTMESSAGEHANDLER_HPP
 
+#include "TokenList.hpp"
+#include "HistoryStore.hpp"
+
 #include <string>
-#include <vector>
 #include <map>
+#include <vector>
 #include <exception>
 
 class Server;
 class Client;
 class Channel;
+class Arena;
+
+typedef void (*CommandHandler)(Server&, Client&, const TokenList&);
 
-typedef void (*CommandHandler)(Server&, Client&, const std::vector<std::string>&);
+// Stable command identifiers, reported by the "command" USDT probe
+enum CommandId
+{
+	CMD_UNKNOWN = 0,
+	CMD_PASS,
+	CMD_NICK,
+	CMD_USER,
+	CMD_PRIVMSG,
+	CMD_JOIN,
+	CMD_PART,
+	CMD_QUIT,
+	CMD_KICK,
+	CMD_INVITE,
+	CMD_TOPIC,
+	CMD_MODE,
+	CMD_PING,
+	CMD_STATS,
+	CMD_NAMES,
+	CMD_NOTICE,
+	CMD_WHO,
+	CMD_WHOIS,
+	CMD_LIST,
+	CMD_MONITOR,
+	CMD_CAP,
+	CMD_CHATHISTORY
+};
 
 class ClientMessageHandler
 {
 	public:
 
+		// A mode the command changed, in order of first change
+		struct ModeTouch
+		{
+			char			mode;
+			const Client*	target;	// 'o' only
+			bool			wasSet;	// 'o', 'b', 'e', 'I': set before the command
+			std::string		mask;	// 'b', 'e', 'I' only
+		};
+
+		// A +b/+e/+I list being edited: changes are staged here and the
+		// compiled list is rebuilt once, after the whole mode string
+		struct MaskEdit
+		{
+			std::map<std::string, std::string>	masks;	// Folded -> as set
+		};
+
 		struct ModeContext
 		{
 			Server*							server;
 			Channel*						channel;
 			Client*							client;
-			const std::vector<std::string>*	tokens;
+			const TokenList*				tokens;
 			size_t							paramIndex;
+			std::vector<ModeTouch>			touched;
+			std::map<char, MaskEdit>		maskEdits;	// By mode letter
 
 			ModeContext();
 		};
 
-		static void handleMessage(Server &server, Client &client);
+		static size_t	handleMessage(Server &server, Client &client,
+			const char *data, size_t len);
 
 	private:
-		static std::map<std::string, CommandHandler>	commandMap;
+		struct CommandEntry
+		{
+			CommandId		id;
+			CommandHandler	handler;
+		};
+
+		static std::map<std::string, CommandEntry>	commandMap;
 		
 		ClientMessageHandler() {} // Block default constructor
 
 		// Command process
 		static void	initCommandMap();
+		static void	addCommand(const std::string &name, CommandId id,
+			CommandHandler handler);
 		static void	processCommand(Server &server, Client &client,
-			const std::vector<std::string> &tokens);
+			const TokenList &tokens, size_t lineLen);
 
 		// Basic IRC commands
 		static void handlePass(Server &server, Client &client,
-			const std::vector<std::string> &tokens);
+			const TokenList &tokens);
 		static void handleNick(Server &server, Client &client,
-			const std::vector<std::string> &tokens);
+			const TokenList &tokens);
 		static void handleUser(Server &server, Client &client,
-			const std::vector<std::string> &tokens);
+			const TokenList &tokens);
 		static void handlePrivMsg(Server &server, Client &client,
-			const std::vector<std::string> &tokens);
+			const TokenList &tokens);
+		static void handleNotice(Server &server, Client &client,
+			const TokenList &tokens);
 		static void handleJoin(Server &server, Client &client,
-			const std::vector<std::string> &tokens);
+			const TokenList &tokens);
 		static void handlePart(Server &server, Client &client,
-			const std::vector<std::string> &tokens);
+			const TokenList &tokens);
 		static void handleQuit(Server &server, Client &client,
-			const std::vector<std::string> &tokens);
+			const TokenList &tokens);
 		static void handlePing(Server &server, Client &client,
-			const std::vector<std::string> &tokens);
+			const TokenList &tokens);
+		static void handleStats(Server &server, Client &client,
+			const TokenList &tokens);
+		static void handleNames(Server &server, Client &client,
+			const TokenList &tokens);
+		static void handleWho(Server &server, Client &client,
+			const TokenList &tokens);
+		static void handleWhois(Server &server, Client &client,
+			const TokenList &tokens);
+		static void handleList(Server &server, Client &client,
+			const TokenList &tokens);
+		static void handleMonitor(Server &server, Client &client,
+			const TokenList &tokens);
+		static void handleCap(Server &server, Client &client,
+			const TokenList &tokens);
+		static void handleChatHistory(Server &server, Client &client,
+			const TokenList &tokens);
 
 		// Operator commands
 		static void handleKick(Server &server, Client &client,
-			const std::vector<std::string> &tokens);
+			const TokenList &tokens);
 		static void handleInvite(Server &server, Client &client,
-			const std::vector<std::string> &tokens);
+			const TokenList &tokens);
 		static void handleTopic(Server &server, Client &client,
-			const std::vector<std::string> &tokens);
+			const TokenList &tokens);
 		static void handleMode(Server &server, Client &client,
-			const std::vector<std::string> &tokens);
+			const TokenList &tokens);
 
+		static void	relayMessage(Server &server, Client &client,
+			const TokenList &tokens, bool notice);
 		static void	changeMode(char mode, char symbol, ModeContext &modeCtx);
-		static int	parseUserLimit(const std::string &param);
+		static void	handleUserMode(Server &server, Client &client,
+			const TokenList &tokens);
+		static void	sendWhois(Server &server, Client &client, const Client *user);
+		static void	sendMonitorStatus(Server &server, Client &client,
+			const TokenList &nicks);
+		static void	sendHistory(Server &server, Client &client,
+			const Channel *channel,
+			const std::vector<const HistoryStore::Record*> &records);
+		static void	touchMode(ModeContext &modeCtx, char mode,
+			const Client *target = NULL, bool wasSet = false,
+			const std::string &mask = std::string());
+		static MaskEdit&	stageMasks(ModeContext &modeCtx, char mode);
+		static void	sendMaskList(Server &server, Client &client,
+			const Channel *channel, char mode);
+		static int	parseUserLimit(const StringRef &param);
 
 		// Utilities
-		static std::vector<std::string>	tokenize(std::string &line);
+		static TokenList	tokenize(Arena &arena, const StringRef &line);
+		static bool			isValidChannelName(const StringRef &name);
+		static bool			isValidNickname(const StringRef &nick);
 		
-		static void			printTokens(const std::vector<std::string> &tokens);
+		static void			printTokens(const TokenList &tokens);
 };
 
 #endif
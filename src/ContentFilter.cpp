@@ -0,0 +1,332 @@
+#include "ContentFilter.hpp"
+#include "StringRef.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+#include "config.hpp"
+
+#include <fstream>
+#include <cctype>
+#include <new>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+static const unsigned int	noState = static_cast<unsigned int>(-1);
+
+// Constructor
+ContentFilter::ContentFilter(const std::string &path) : path(path),
+	current(NULL), pending(NULL), building(false), bytesScanned(0), hits(0) {}
+
+// Destructor
+ContentFilter::~ContentFilter()
+{
+	if (building)
+	{
+		pthread_join(builder, NULL);
+		delete __atomic_exchange_n(&pending, static_cast<Automaton*>(NULL),
+			__ATOMIC_ACQ_REL);
+	}
+	delete current;
+}
+
+// Getter
+FilterStats	ContentFilter::getStats()
+{
+	FilterStats	st = { 0, 0, 0, 0, bytesScanned, hits };
+
+	adopt();
+	if (current)
+	{
+		st.patterns = current->patterns.size();
+		st.classes = current->classes;
+		st.states = current->classes ? current->next.size() / current->classes : 0;
+		st.tableBytes = current->next.size() * sizeof(unsigned int)
+						+ current->output.size() * sizeof(int);
+	}
+	return (st);
+}
+
+const char*	ContentFilter::actionName(Action action)
+{
+	static const char	*names[] = { "none", "notify", "drop", "kill" };
+
+	return (names[action]);
+}
+
+// Utilities
+void	ContentFilter::reload()
+{
+	if (building)
+	{
+		LOG_WARN("Content filter: reload already in progress");
+		return ;
+	}
+	if (pthread_create(&builder, NULL, &ContentFilter::buildMain, this) != 0)
+	{
+		LOG_ERROR("Content filter: cannot start builder thread");
+		return ;
+	}
+	building = true;
+}
+
+// Swaps in a finished build; runs on the event loop only
+void	ContentFilter::adopt()
+{
+	if (!building)
+		return ;
+
+	Automaton *ready = __atomic_exchange_n(&pending, static_cast<Automaton*>(NULL),
+		__ATOMIC_ACQ_REL);
+
+	if (!ready)
+		return ;
+	pthread_join(builder, NULL);
+	building = false;
+
+	if (!ready->error.empty())
+	{
+		LOG_WARN("Content filter: " + ready->error + ", keeping previous rules");
+		delete ready;
+		return ;
+	}
+	delete current;
+	current = ready;
+	LOG_INFO("Content filter: "
+		+ Utils::toString(static_cast<int>(current->patterns.size())) + " patterns loaded");
+}
+
+ContentFilter::Match	ContentFilter::scan(const StringRef &text)
+{
+	Match	match = { NONE, NULL };
+
+	adopt();
+	if (!current || current->patterns.empty() || text.empty())
+		return (match);
+
+	const Automaton			&a = *current;
+	const unsigned char		*p = reinterpret_cast<const unsigned char*>(text.data());
+	const unsigned char		*end = p + text.size();
+	unsigned int			state = 0;
+
+	while (p < end)
+	{
+		if (state == 0)
+		{
+			p = skipToStart(a, p, end);
+			if (p == end)
+				break ;
+		}
+		state = a.next[state * a.classes + a.classOf[*p++]];
+
+		int rule = a.output[state];
+
+		if (rule >= 0 && a.actions[rule] > match.action)
+		{
+			match.action = static_cast<Action>(a.actions[rule]);
+			match.pattern = &a.patterns[rule];
+			if (match.action == KILL)
+				break ;
+		}
+	}
+	bytesScanned += text.size();
+	if (match.action != NONE)
+		++hits;
+	return (match);
+}
+
+const unsigned char*	ContentFilter::skipToStart(const Automaton &a,
+							const unsigned char *p, const unsigned char *end)
+{
+#ifdef __SSE2__
+	if (a.needleCount)
+	{
+		while (end - p >= 16)
+		{
+			__m128i	block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			__m128i	found = _mm_setzero_si128();
+
+			for (size_t n = 0; n < a.needleCount; ++n)
+				found = _mm_or_si128(found, _mm_cmpeq_epi8(block,
+							_mm_set1_epi8(static_cast<char>(a.needles[n]))));
+
+			int mask = _mm_movemask_epi8(found);
+
+			if (mask)
+				return (p + __builtin_ctz(mask));
+			p += 16;
+		}
+	}
+#endif
+	while (p < end && !a.isStart[*p])
+		++p;
+	return (p);
+}
+
+// Builder thread: compiles and publishes, never logs (the log ring has a
+// single producer, the event loop)
+void*	ContentFilter::buildMain(void *arg)
+{
+	ContentFilter	*self = static_cast<ContentFilter*>(arg);
+	Automaton		*built = compile(self->path);
+
+	__atomic_store_n(&self->pending, built, __ATOMIC_RELEASE);
+	return (NULL);
+}
+
+ContentFilter::Automaton*	ContentFilter::compile(const std::string &path)
+{
+	Automaton		*a = new Automaton();
+	std::ifstream	file(path.c_str());
+	std::string		line;
+
+	// No rule file simply means no rules
+	while (file && std::getline(file, line))
+	{
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		if (line.empty() || line[0] == '#')
+			continue ;
+
+		size_t			space = line.find(' ');
+		std::string		verb = line.substr(0, space);
+		unsigned char	action;
+
+		if (verb == "notify")
+			action = NOTIFY;
+		else if (verb == "drop")
+			action = DROP;
+		else if (verb == "kill")
+			action = KILL;
+		else
+		{
+			a->error = "unknown action \"" + verb + "\"";
+			return (a);
+		}
+
+		size_t first = line.find_first_not_of(' ', space);
+
+		if (space == std::string::npos || first == std::string::npos)
+			continue ;
+		if (a->patterns.size() == serverConfig::filterMaxPatterns)
+		{
+			a->error = "more than "
+				+ Utils::toString(static_cast<int>(serverConfig::filterMaxPatterns))
+				+ " patterns";
+			return (a);
+		}
+
+		std::string pattern = line.substr(first);
+
+		for (size_t i = 0; i < pattern.size(); ++i)
+			pattern[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(pattern[i])));
+		a->patterns.push_back(pattern);
+		a->actions.push_back(action);
+	}
+
+	try
+	{
+		build(*a);
+	}
+	catch (const std::bad_alloc &)
+	{
+		a->error = "out of memory while compiling";
+	}
+	return (a);
+}
+
+// Goto function over byte classes, then failure links folded into a
+// dense transition table (breadth first, so every state's fallback row
+// is complete before it is needed)
+void	ContentFilter::build(Automaton &a)
+{
+	// Byte classes: one per distinct folded byte, 0 for everything else
+	for (size_t b = 0; b < 256; ++b)
+		a.classOf[b] = 0;
+	a.classes = 1;
+	for (size_t i = 0; i < a.patterns.size(); ++i)
+	{
+		for (size_t j = 0; j < a.patterns[i].size(); ++j)
+		{
+			unsigned char c = static_cast<unsigned char>(a.patterns[i][j]);
+
+			if (!a.classOf[c])
+				a.classOf[c] = static_cast<unsigned char>(a.classes++);
+		}
+	}
+	for (size_t b = 0; b < 256; ++b)
+		a.classOf[b] = a.classOf[static_cast<unsigned char>(std::tolower(static_cast<int>(b)))];
+
+	size_t	k = a.classes;
+
+	a.next.assign(k, noState);
+	a.output.assign(1, -1);
+	for (size_t i = 0; i < a.patterns.size(); ++i)
+	{
+		unsigned int state = 0;
+
+		for (size_t j = 0; j < a.patterns[i].size(); ++j)
+		{
+			size_t slot = state * k + a.classOf[static_cast<unsigned char>(a.patterns[i][j])];
+
+			if (a.next[slot] == noState)
+			{
+				a.next[slot] = static_cast<unsigned int>(a.output.size());
+				a.output.push_back(-1);
+				a.next.resize(a.output.size() * k, noState);
+			}
+			state = a.next[slot];
+		}
+		if (a.output[state] < 0 || a.actions[i] > a.actions[a.output[state]])
+			a.output[state] = static_cast<int>(i);
+	}
+
+	std::vector<unsigned int>	fail(a.output.size(), 0);
+	std::vector<unsigned int>	queue;
+
+	for (size_t c = 0; c < k; ++c)
+	{
+		if (a.next[c] == noState)
+			a.next[c] = 0;
+		else
+			queue.push_back(a.next[c]);
+	}
+	for (size_t q = 0; q < queue.size(); ++q)
+	{
+		unsigned int	s = queue[q];
+		int				inherited = a.output[fail[s]];
+
+		if (inherited >= 0
+			&& (a.output[s] < 0 || a.actions[inherited] > a.actions[a.output[s]]))
+			a.output[s] = inherited;
+
+		for (size_t c = 0; c < k; ++c)
+		{
+			unsigned int	t = a.next[s * k + c];
+			unsigned int	f = a.next[fail[s] * k + c];
+
+			if (t == noState)
+				a.next[s * k + c] = f;
+			else
+			{
+				fail[t] = f;
+				queue.push_back(t);
+			}
+		}
+	}
+
+	// Root skip table, and SSE2 needles when the start set is small
+	a.needleCount = 0;
+	for (size_t b = 0; b < 256; ++b)
+	{
+		a.isStart[b] = (a.next[a.classOf[b]] != 0);
+		if (a.isStart[b] && a.needleCount <= 8)
+		{
+			if (a.needleCount < 8)
+				a.needles[a.needleCount] = static_cast<unsigned char>(b);
+			++a.needleCount;
+		}
+	}
+	if (a.needleCount > 8)
+		a.needleCount = 0;
+}
@@ -0,0 +1,101 @@
+#ifndef CONTENTFILTER_HPP
+#define CONTENTFILTER_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <pthread.h>
+
+class StringRef;
+
+struct FilterStats
+{
+	size_t	patterns;
+	size_t	states;
+	size_t	classes;
+	size_t	tableBytes;
+	size_t	bytesScanned;
+	size_t	hits;
+};
+
+// Server-side content filter for channel traffic. The rule file holds
+// one "<drop|notify|kill> <phrase>" per line; phrases are matched case
+// insensitively anywhere in the message text. All phrases are compiled
+// into one Aho-Corasick automaton over byte classes, so a message is
+// scanned once whatever the number of rules. While the automaton sits in
+// its root state, bytes that cannot start a match are skipped, sixteen at
+// a time with SSE2 when only a few start bytes exist.
+//
+// reload() compiles the file on a background thread; the event loop
+// adopts the result at its next scan, so the loop never waits on a build.
+class ContentFilter
+{
+	public:
+		// Ordered by severity, the strongest hit wins
+		enum Action
+		{
+			NONE,
+			NOTIFY,
+			DROP,
+			KILL
+		};
+
+		struct Match
+		{
+			Action				action;
+			const std::string	*pattern;	// Valid until the next scan()
+		};
+
+	private:
+		struct Automaton
+		{
+			std::vector<std::string>	patterns;
+			std::vector<unsigned char>	actions;	// Per pattern
+			unsigned char				classOf[256];
+			size_t						classes;
+			std::vector<unsigned int>	next;		// states x classes
+			std::vector<int>			output;		// Strongest pattern per state
+			bool						isStart[256];
+			unsigned char				needles[8];	// Start bytes for SSE2
+			size_t						needleCount;	// 0 = scalar skip only
+			std::string					error;
+		};
+
+		std::string		path;
+		Automaton		*current;
+		Automaton		*pending;	// Published by the builder thread
+		pthread_t		builder;
+		bool			building;
+		size_t			bytesScanned;
+		size_t			hits;
+
+		ContentFilter(); // Block default constructor
+		ContentFilter(const ContentFilter &other); // Block copy
+		ContentFilter&	operator=(const ContentFilter &other);
+
+		void	adopt();
+
+		static void*		buildMain(void *arg);
+		static Automaton*	compile(const std::string &path);
+		static void			build(Automaton &a);
+		static const unsigned char*	skipToStart(const Automaton &a,
+										const unsigned char *p, const unsigned char *end);
+
+	public:
+		// Constructor
+		explicit ContentFilter(const std::string &path);
+
+		// Destructor
+		~ContentFilter();
+
+		// Getter
+		FilterStats	getStats();
+
+		// Utilities
+		void	reload();	// No-op while a build is still running
+		Match	scan(const StringRef &text);
+
+		static const char*	actionName(Action action);
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef HASHREGISTRY_HPP
+#define HASHREGISTRY_HPP
+
+#include "CaseMap.hpp"
+#include "StringRef.hpp"
+#include "IString.hpp"
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Open addressing (linear probing) name -> T* table. Keys are stored
+// casefolded together with their hash; lookups fold the probe name on
+// the fly, so find() never allocates. Deletion uses backward shifting,
+// so there are no tombstones to clean up.
+template <typename T>
+class HashRegistry
+{
+	private:
+		struct Slot
+		{
+			IString		key;	// Casefolded name, interned
+			size_t		hash;
+			T			*value;	// NULL when the slot is empty
+
+			Slot() : hash(0), value(NULL) {}
+		};
+
+		std::vector<Slot>	slots;
+		size_t				count;
+
+		static size_t	hashName(const StringRef &name)
+		{
+			size_t h = 2166136261u;
+
+			for (size_t i = 0; i < name.size(); ++i)
+			{
+				h ^= static_cast<unsigned char>(CaseMap::foldChar(name[i]));
+				h *= 16777619u;
+			}
+			return (h);
+		}
+
+		static bool	sameKey(const Slot &slot, const StringRef &name, size_t hash)
+		{
+			if (slot.hash != hash || slot.key.size() != name.size())
+				return (false);
+
+			const std::string &key = slot.key.str();
+
+			for (size_t i = 0; i < name.size(); ++i)
+			{
+				if (key[i] != CaseMap::foldChar(name[i]))
+					return (false);
+			}
+			return (true);
+		}
+
+		// Index of the slot holding name, or of the empty slot ending its probe
+		size_t	locate(const StringRef &name, size_t hash) const
+		{
+			size_t mask = slots.size() - 1;
+			size_t i = hash & mask;
+
+			while (slots[i].value && !sameKey(slots[i], name, hash))
+				i = (i + 1) & mask;
+			return (i);
+		}
+
+		void	grow()
+		{
+			std::vector<Slot> old(slots.size() * 2);
+
+			old.swap(slots);
+			for (size_t i = 0; i < old.size(); ++i)
+			{
+				if (!old[i].value)
+					continue ;
+
+				size_t j = old[i].hash & (slots.size() - 1);
+				while (slots[j].value)
+					j = (j + 1) & (slots.size() - 1);
+				slots[j].key.swap(old[i].key);
+				slots[j].hash = old[i].hash;
+				slots[j].value = old[i].value;
+			}
+		}
+
+	public:
+		// Constructor
+		HashRegistry() : slots(16), count(0) {}
+
+		// Lookup
+		T*	find(const StringRef &name) const
+		{
+			return (slots[locate(name, hashName(name))].value);
+		}
+
+		// Returns false (and leaves the table untouched) if name is taken
+		bool	insert(const std::string &name, T *value)
+		{
+			if ((count + 1) * 2 > slots.size())
+				grow();
+
+			size_t	hash = hashName(name);
+			Slot	&slot = slots[locate(name, hash)];
+
+			if (slot.value)
+				return (false);
+			slot.key = IString(CaseMap::fold(name));
+			slot.hash = hash;
+			slot.value = value;
+			++count;
+			return (true);
+		}
+
+		T*	erase(const std::string &name)
+		{
+			size_t	mask = slots.size() - 1;
+			size_t	i = locate(name, hashName(name));
+			T		*removed = slots[i].value;
+
+			if (!removed)
+				return (NULL);
+
+			// Shift back every entry whose probe sequence crossed slot i
+			size_t j = i;
+			while (true)
+			{
+				j = (j + 1) & mask;
+				if (!slots[j].value)
+					break ;
+
+				size_t home = slots[j].hash & mask;
+				bool stays = (i <= j) ? (i < home && home <= j)
+									: (i < home || home <= j);
+				if (stays)
+					continue ;
+				slots[i].key.swap(slots[j].key);
+				slots[i].hash = slots[j].hash;
+				slots[i].value = slots[j].value;
+				i = j;
+			}
+			slots[i].key.clear();
+			slots[i].value = NULL;
+			--count;
+			return (removed);
+		}
+
+		void	clear()
+		{
+			slots.assign(16, Slot());
+			count = 0;
+		}
+
+		// Iteration over raw slots: slotValue() is NULL for empty ones
+		size_t	size() const { return (count); }
+		size_t	capacity() const { return (slots.size()); }
+		T*		slotValue(size_t index) const { return (slots[index].value); }
+};
+
+#endif
@@ -0,0 +1,289 @@
+#include "HistoryStore.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+
+// ------------- Ring -----------//
+
+HistoryStore::Ring::Ring() : head(0), count(0), lastId(0) {}
+
+const HistoryStore::Record&	HistoryStore::Ring::at(size_t i) const
+{
+	return (slots[(head + i) % slots.size()]);
+}
+
+// ------------- HistoryStore -----------//
+
+// Constructor
+HistoryStore::HistoryStore(size_t perChannel, size_t budget)
+	: perChannel(perChannel), budget(budget), bytes(0), records(0), evicted(0),
+	nextId(1) {}
+
+// Destructor
+HistoryStore::~HistoryStore()
+{
+	clear();
+}
+
+// Getter
+HistoryStats	HistoryStore::getStats() const
+{
+	HistoryStats	st = { rings.size(), records, bytes, budget, evicted };
+
+	return (st);
+}
+
+void	HistoryStore::latest(const Channel *channel, const Anchor *since,
+			size_t limit, std::vector<const Record*> &out) const
+{
+	const Ring *ring = findRing(channel);
+
+	if (!ring)
+		return ;
+
+	size_t first = ring->count > limit ? ring->count - limit : 0;
+
+	if (since)
+		first = std::max(first, firstAtOrAfter(*ring, *since, false));
+
+	for (size_t i = first; i < ring->count; ++i)
+		out.push_back(&ring->at(i));
+}
+
+void	HistoryStore::before(const Channel *channel, const Anchor &anchor,
+			size_t limit, std::vector<const Record*> &out) const
+{
+	const Ring *ring = findRing(channel);
+
+	if (!ring)
+		return ;
+
+	size_t end = firstAtOrAfter(*ring, anchor, true);
+	size_t first = end > limit ? end - limit : 0;
+
+	for (size_t i = first; i < end; ++i)
+		out.push_back(&ring->at(i));
+}
+
+void	HistoryStore::after(const Channel *channel, const Anchor &anchor,
+			size_t limit, std::vector<const Record*> &out) const
+{
+	const Ring *ring = findRing(channel);
+
+	if (!ring)
+		return ;
+
+	for (size_t i = firstAtOrAfter(*ring, anchor, false);
+		i < ring->count && out.size() < limit; ++i)
+		out.push_back(&ring->at(i));
+}
+
+const char*	HistoryStore::kindName(unsigned char kind)
+{
+	static const char	*names[] = { "PRIVMSG", "NOTICE", "JOIN", "PART", "TOPIC" };
+
+	return (names[kind]);
+}
+
+const HistoryStore::Ring*	HistoryStore::findRing(const Channel *channel) const
+{
+	RingMap::const_iterator it = rings.find(channel);
+
+	return (it == rings.end() ? NULL : it->second);
+}
+
+// Index of the first record whose key is >= anchor (inclusive) or
+// > anchor; ids and times both only grow along a ring
+size_t	HistoryStore::firstAtOrAfter(const Ring &ring, const Anchor &anchor,
+			bool inclusive) const
+{
+	size_t	first = 0;
+	size_t	len = ring.count;
+
+	while (len > 0)
+	{
+		size_t			step = len / 2;
+		const Record	&r = ring.at(first + step);
+		unsigned long	key = anchor.byTime ? r.time : r.id;
+
+		if (key < anchor.value || (!inclusive && key == anchor.value))
+		{
+			first += step + 1;
+			len -= step + 1;
+		}
+		else
+			len = step;
+	}
+	return (first);
+}
+
+bool	HistoryStore::covers(const Channel *channel, const Anchor &anchor) const
+{
+	const Ring *ring = findRing(channel);
+
+	if (!ring || !ring->count)
+		return (false);
+
+	const Record &oldest = ring->at(0);
+
+	return ((anchor.byTime ? oldest.time : oldest.id) <= anchor.value);
+}
+
+// Utilities
+HistoryStore::Record	HistoryStore::stamp(Kind kind, const IString &source,
+							const IString &text)
+{
+	Record	record;
+
+	record.id = nextId++;
+	record.time = Utils::nowMillis();
+	record.source = source;
+	record.text = text;
+	record.kind = static_cast<unsigned char>(kind);
+	return (record);
+}
+
+void	HistoryStore::append(const Channel *channel, const Record &record)
+{
+	if (!perChannel || !budget)
+		return ;
+
+	Ring	*&slot = rings[channel];
+
+	if (!slot)
+		slot = new Ring();
+
+	Ring	&ring = *slot;
+
+	if (ring.count == perChannel)
+		popOldest(slot);
+	if (ring.count == ring.slots.size())
+	{
+		// Grow in place; a ring that lost records to the budget is
+		// straightened first so the new slot lands after the newest
+		std::rotate(ring.slots.begin(), ring.slots.begin() + ring.head,
+			ring.slots.end());
+		ring.head = 0;
+		ring.slots.push_back(record);
+	}
+	else
+		ring.slots[(ring.head + ring.count) % ring.slots.size()] = record;
+	++ring.count;
+	++records;
+	charge(record);
+
+	byActivity.erase(std::make_pair(ring.lastId, channel));
+	ring.lastId = record.id;
+	byActivity.insert(std::make_pair(ring.lastId, channel));
+
+	while (bytes > budget && records)
+		evictColdest();
+}
+
+void	HistoryStore::setNextId(unsigned long id)
+{
+	if (id > nextId)
+		nextId = id;
+}
+
+void	HistoryStore::drop(const Channel *channel)
+{
+	RingMap::iterator it = rings.find(channel);
+
+	if (it == rings.end())
+		return ;
+
+	Ring *ring = it->second;
+
+	for (size_t i = 0; i < ring->count; ++i)
+		release(ring->at(i));
+	records -= ring->count;
+	byActivity.erase(std::make_pair(ring->lastId, channel));
+	rings.erase(it);
+	delete ring;
+}
+
+void	HistoryStore::clear()
+{
+	for (RingMap::iterator it = rings.begin(); it != rings.end(); ++it)
+		delete it->second;
+	rings.clear();
+	byActivity.clear();
+	payloads.clear();
+	bytes = 0;
+	records = 0;
+}
+
+// Releases the oldest record's payloads; the slot itself is reused
+void	HistoryStore::popOldest(Ring *ring)
+{
+	Record &oldest = ring->slots[ring->head];
+
+	release(oldest);
+	--records;
+	oldest.source.clear();
+	oldest.text.clear();
+	ring->head = (ring->head + 1) % ring->slots.size();
+	--ring->count;
+}
+
+void	HistoryStore::evictColdest()
+{
+	const Channel	*channel = byActivity.begin()->second;
+	Ring			*ring = rings[channel];
+
+	popOldest(ring);
+	++evicted;
+	if (!ring->count)
+		drop(channel);
+	else if (ring->count < ring->slots.size() / 2)
+		shrink(ring);
+}
+
+void	HistoryStore::charge(const Record &record)
+{
+	bytes += sizeof(Record);
+	holdPayload(record.source);
+	holdPayload(record.text);
+}
+
+void	HistoryStore::release(const Record &record)
+{
+	bytes -= sizeof(Record);
+	dropPayload(record.source);
+	dropPayload(record.text);
+}
+
+// Interned payloads are keyed by their shared text, so only the first
+// record holding one pays for its bytes
+void	HistoryStore::holdPayload(const IString &payload)
+{
+	if (payload.empty())
+		return ;
+	if (payloads[&payload.str()]++ == 0)
+		bytes += payload.size();
+}
+
+void	HistoryStore::dropPayload(const IString &payload)
+{
+	if (payload.empty())
+		return ;
+
+	PayloadRefs::iterator it = payloads.find(&payload.str());
+
+	if (it != payloads.end() && --it->second == 0)
+	{
+		bytes -= payload.size();
+		payloads.erase(it);
+	}
+}
+
+// Straightens the ring and trades its slots for a right-sized vector
+void	HistoryStore::shrink(Ring *ring)
+{
+	std::rotate(ring->slots.begin(), ring->slots.begin() + ring->head,
+		ring->slots.end());
+	ring->head = 0;
+	std::vector<Record>(ring->slots.begin(),
+		ring->slots.begin() + ring->count).swap(ring->slots);
+}
@@ -0,0 +1,131 @@
+#ifndef HISTORYSTORE_HPP
+#define HISTORYSTORE_HPP
+
+#include "IString.hpp"
+
+#include <vector>
+#include <map>
+#include <set>
+#include <cstddef>
+
+class Channel;
+
+struct HistoryStats
+{
+	size_t	channels;
+	size_t	records;
+	size_t	bytes;
+	size_t	budget;
+	size_t	evicted;	// Dropped by the budget, not by ring wrap
+};
+
+// Recent channel events for CHATHISTORY. Each channel gets a fixed size
+// ring of compact records; sources and texts are interned, so a message
+// sent to several channels (or repeated) stores its payload once. All
+// rings share one byte budget, charged per record slot plus once per
+// distinct payload still referenced by any ring: when it is exceeded, the
+// oldest records of the channel that has been quiet the longest go first,
+// and a ring the budget leaves under half full is shrunk.
+class HistoryStore
+{
+	public:
+		enum Kind
+		{
+			PRIVMSG,
+			NOTICE,
+			JOIN,
+			PART,
+			TOPIC
+		};
+
+		struct Record
+		{
+			unsigned long	id;		// msgid: server wide, increasing
+			unsigned long	time;	// Milliseconds since the epoch
+			IString			source;	// ":nick!user@host"
+			IString			text;
+			unsigned char	kind;
+		};
+
+		// A CHATHISTORY reference: msgid=<id> or timestamp=<time>
+		struct Anchor
+		{
+			bool			byTime;
+			unsigned long	value;
+		};
+
+	private:
+		struct Ring
+		{
+			std::vector<Record>	slots;
+			size_t				head;	// Oldest record
+			size_t				count;
+			unsigned long		lastId;	// Activity key, see byActivity
+
+			Ring();
+			const Record&	at(size_t i) const;	// i = 0 is the oldest
+		};
+
+		typedef std::map<const Channel*, Ring*>						RingMap;
+		typedef std::set<std::pair<unsigned long, const Channel*> >	ActivitySet;
+		typedef std::map<const std::string*, size_t>				PayloadRefs;
+
+		RingMap			rings;
+		ActivitySet		byActivity;	// Coldest (lowest last id) first
+		PayloadRefs		payloads;	// Interned text -> records holding it
+		size_t			perChannel;
+		size_t			budget;
+		size_t			bytes;
+		size_t			records;
+		size_t			evicted;
+		unsigned long	nextId;
+
+		HistoryStore(); // Block default constructor
+		HistoryStore(const HistoryStore &other); // Block copy
+		HistoryStore&	operator=(const HistoryStore &other);
+
+		const Ring*		findRing(const Channel *channel) const;
+		size_t			firstAtOrAfter(const Ring &ring, const Anchor &anchor,
+							bool inclusive) const;
+		void			popOldest(Ring *ring);
+		void			evictColdest();
+		void			charge(const Record &record);
+		void			release(const Record &record);
+		void			holdPayload(const IString &payload);
+		void			dropPayload(const IString &payload);
+
+		static void		shrink(Ring *ring);
+
+	public:
+		// Constructor
+		HistoryStore(size_t perChannel, size_t budget);
+
+		// Destructor
+		~HistoryStore();
+
+		// Getter
+		HistoryStats	getStats() const;
+
+		// Queries fill out in chronological order, at most limit records;
+		// latest() stops at since when given
+		void	latest(const Channel *channel, const Anchor *since, size_t limit,
+					std::vector<const Record*> &out) const;
+		void	before(const Channel *channel, const Anchor &anchor, size_t limit,
+					std::vector<const Record*> &out) const;
+		void	after(const Channel *channel, const Anchor &anchor, size_t limit,
+					std::vector<const Record*> &out) const;
+
+		static const char*	kindName(unsigned char kind);	// Command word
+
+		// True when the ring still holds records from anchor onwards
+		bool	covers(const Channel *channel, const Anchor &anchor) const;
+
+		// Utilities
+		Record	stamp(Kind kind, const IString &source, const IString &text);
+		void	append(const Channel *channel, const Record &record);
+		void	setNextId(unsigned long id);	// Never moves backwards
+		void	drop(const Channel *channel);
+		void	clear();
+};
+
+#endif
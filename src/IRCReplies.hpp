@@ -7,18 +7,40 @@
 
 #define	RPL_WELCOME			001	// "Welcome to the IRC network <nick>"
 
-#define	RPL_YOURHOST		002
-#define	RPL_CREATED			003
-#define	RPL_MYINFO			004
-
+#define	RPL_YOURHOST		002	// "Your host is <servername>, running version <ver>"
+#define	RPL_CREATED			003	// "This server was created <date>"
+#define	RPL_MYINFO			004	// "<servername> <version> <usermodes> <chanmodes>"
+#define	RPL_ISUPPORT		005	// "<client> <1-13 tokens> :are supported by this server"
+
+#define RPL_WHOISUSER		311	// "<client> <nick> <user> <host> * :<real name>"
+#define RPL_WHOISSERVER		312	// "<client> <nick> <server> :<server info>"
+#define RPL_ENDOFWHO		315	// "<client> <mask> :End of WHO list"
+#define RPL_ENDOFWHOIS		318	// "<client> <nick> :End of /WHOIS list"
+#define RPL_WHOISCHANNELS	319	// "<client> <nick> :{[@]<channel> }"
+#define RPL_WHOREPLY		352	// "<client> <channel> <user> <host> <server> <nick> <flags> :<hops> <real name>"
+#define RPL_LISTSTART		321	// "<client> Channel :Users  Name"
+#define RPL_LIST			322	// "<client> <channel> <client count> :<topic>"
+#define RPL_LISTEND			323	// "<client> :End of /LIST"
 #define RPL_TOPIC			332	// "<client> <channel> :<topic>"
 #define RPL_NOTOPIC			331	// "<client> <channel> :No topic is set"
 #define RPL_INVITING		341 // "<client> <user> <channel>"
 #define	RPL_NAMEREPLY		353	// "<client> = <channel> :[nickname {space nickname}*]"
 #define	RPL_ENDOFNAMES		366	// "<client> <channel> :End of NAMES list"
 
-#define RPL_CHANNELMODEIS   312 // "<chanel> <mode> <mode params>"
+#define RPL_CHANNELMODEIS   324 // "<chanel> <mode> <mode params>"
+#define RPL_ENDOFSTATS		219	// "<client> <stats letter> :End of /STATS report"
+#define RPL_STATSDEBUG		249	// "<client> :<free form stats line>"
 #define RPL_UMODEIS         221 // "<user mode string>"
+#define RPL_INVITELIST		346	// "<client> <channel> <mask>"
+#define RPL_ENDOFINVITELIST	347	// "<client> <channel> :End of channel invite list"
+#define RPL_EXCEPTLIST		348	// "<client> <channel> <mask>"
+#define RPL_ENDOFEXCEPTLIST	349	// "<client> <channel> :End of channel exception list"
+#define RPL_BANLIST			367	// "<client> <channel> <mask>"
+#define RPL_ENDOFBANLIST	368	// "<client> <channel> :End of channel ban list"
+#define RPL_MONONLINE		730	// "<client> :<nick>!<user>@<host>[,...]"
+#define RPL_MONOFFLINE		731	// "<client> :<nick>[,...]"
+#define RPL_MONLIST			732	// "<client> :<nick>[,...]"
+#define RPL_ENDOFMONLIST	733	// "<client> :End of MONITOR list"
 
 // ============================
 //  ERROR REPLIES (ERR_)
@@ -32,6 +54,9 @@
 // --- JOIN ---
 #define ERR_BADCHANNELKEY		475	// "<nick> <channel> :Cannot join channel (+k) - password required"
 #define ERR_INVITEONLYCHAN		473	// "<nick> <channel> :Cannot join channel (+i)"
+#define ERR_TOOMANYCHANNELS		405	// "<channel> :You have joined too many channels"
+#define ERR_UNAVAILRESOURCE		437	// "<channel> :Nick/channel is temporarily unavailable"
+#define ERR_BANNEDFROMCHAN		474	// "<channel> :Cannot join channel (+b)"
 
 #define ERR_CHANOPRIVSNEEDED	482	// "<client> <channel> :You're not channel operator"
 
@@ -45,12 +70,14 @@
 
 // --- PRIVMSG / NOTICE ---
 #define	ERR_NORECIPIENT			411	// ":No recipient given (<command>)"
+#define	ERR_TOOMANYTARGETS		407	// "<target> :Too many recipients"
 #define	ERR_NOTEXTTOSEND		412	// ":No text to send"
 #define	ERR_NOSUCHNICK			401	// "<nick> :No such nick"
 #define	ERR_NOSUCHCHANNEL		403	// "<channel> :No such channel"
 
 // --- GENERAL ---
 #define	ERR_UNKNOWNCOMMAND		421	// "<command> :Unknown command"
+#define	ERR_INVALIDCAPCMD		410	// "<client> <subcommand> :Invalid CAP command"
 #define	ERR_NOTREGISTERED		451	// ":You have not registered"
 
 // --- CHANNELS ---
@@ -62,9 +89,13 @@
 
 // --- MODE ---
 #define ERR_KEYSET				467	// "<client> <channel> :Channel key already set"
+#define ERR_BANLISTFULL			478	// "<channel> <char> :Channel list is full"
 #define ERR_CHANOPRIVSNEEDED    482 // "<channel> :You're not channel operator"
 #define ERR_UNKNOWNMODE         472 // "<char> : is unkown mode char to me"
 #define ERR_USERSDONTMATCH      502 // ":Cant change mode for other users"
 #define ERR_UMODEUNKOWNFLAG     501 // ":UKnown MODE flag"
 
+// --- MONITOR ---
+#define ERR_MONLISTFULL			734	// "<client> <limit> <targets> :Monitor list is full"
+
 #endif
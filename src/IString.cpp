@@ -0,0 +1,199 @@
+#include "IString.hpp"
+#include "config.hpp"
+
+#include <cstring>
+
+std::vector<IString::Entry*>	IString::buckets(256, static_cast<Entry*>(NULL));
+size_t							IString::entryCount = 0;
+InternStats						IString::stats = { 0, 0, 0, 0 };
+ObjectPool<IString::Entry>		IString::entryPool("intern",
+									serverConfig::slabBytes, serverConfig::hugePages);
+
+static const std::string	emptyText;
+
+IString::Entry::Entry(const std::string &text, size_t hash) : next(NULL),
+	hash(hash), refs(0), text(text) {}
+
+// Constructor
+IString::IString() : entry(NULL) {}
+
+IString::IString(const std::string &text) : entry(NULL)
+{
+	if (!text.empty())
+	{
+		entry = intern(text.data(), text.size());
+		retain();
+	}
+}
+
+IString::IString(const char *data, size_t len) : entry(NULL)
+{
+	if (len)
+	{
+		entry = intern(data, len);
+		retain();
+	}
+}
+
+IString::IString(const IString &other) : entry(other.entry)
+{
+	retain();
+}
+
+// Destructor
+IString::~IString()
+{
+	release();
+}
+
+IString&	IString::operator=(const IString &other)
+{
+	if (entry != other.entry)
+	{
+		IString copy(other);
+		swap(copy);
+	}
+	return (*this);
+}
+
+bool	IString::operator==(const IString &other) const
+{
+	return (entry == other.entry);
+}
+
+bool	IString::operator!=(const IString &other) const
+{
+	return (entry != other.entry);
+}
+
+// Getter
+const std::string&	IString::str() const
+{
+	return (entry ? entry->text : emptyText);
+}
+
+size_t	IString::size() const
+{
+	return (entry ? entry->text.size() : 0);
+}
+
+bool	IString::empty() const
+{
+	return (entry == NULL);
+}
+
+InternStats	IString::getStats()
+{
+	return (stats);
+}
+
+const PoolStats&	IString::getPoolStats()
+{
+	return (entryPool.getStats());
+}
+
+// Utilities
+void	IString::swap(IString &other)
+{
+	Entry *tmp = entry;
+
+	entry = other.entry;
+	other.entry = tmp;
+}
+
+void	IString::clear()
+{
+	release();
+	entry = NULL;
+}
+
+size_t	IString::hashText(const char *data, size_t len)
+{
+	size_t h = 2166136261u;
+
+	for (size_t i = 0; i < len; ++i)
+	{
+		h ^= static_cast<unsigned char>(data[i]);
+		h *= 16777619u;
+	}
+	return (h);
+}
+
+// Finds or creates the entry for data; the caller takes the reference
+IString::Entry*	IString::intern(const char *data, size_t len)
+{
+	size_t	hash = hashText(data, len);
+	Entry	*e = buckets[hash & (buckets.size() - 1)];
+
+	for (; e; e = e->next)
+	{
+		if (e->hash == hash && e->text.size() == len
+			&& std::memcmp(e->text.data(), data, len) == 0)
+			return (e);
+	}
+
+	if (entryCount + 1 > buckets.size())
+		grow();
+
+	e = entryPool.create(std::string(data, len), hash);
+
+	Entry **head = &buckets[hash & (buckets.size() - 1)];
+	e->next = *head;
+	*head = e;
+	++entryCount;
+	stats.entries = entryCount;
+	stats.bytesStored += len;
+	return (e);
+}
+
+void	IString::grow()
+{
+	std::vector<Entry*> old(buckets.size() * 2, static_cast<Entry*>(NULL));
+
+	old.swap(buckets);
+	for (size_t i = 0; i < old.size(); ++i)
+	{
+		Entry *e = old[i];
+
+		while (e)
+		{
+			Entry *next = e->next;
+			Entry **head = &buckets[e->hash & (buckets.size() - 1)];
+
+			e->next = *head;
+			*head = e;
+			e = next;
+		}
+	}
+}
+
+void	IString::retain()
+{
+	if (!entry)
+		return ;
+	++entry->refs;
+	++stats.references;
+	stats.bytesLogical += entry->text.size();
+}
+
+// Drops this handle's reference and frees the entry with the last one
+void	IString::release()
+{
+	if (!entry)
+		return ;
+
+	--stats.references;
+	stats.bytesLogical -= entry->text.size();
+	if (--entry->refs > 0)
+		return ;
+
+	Entry **link = &buckets[entry->hash & (buckets.size() - 1)];
+	while (*link != entry)
+		link = &(*link)->next;
+	*link = entry->next;
+
+	--entryCount;
+	stats.entries = entryCount;
+	stats.bytesStored -= entry->text.size();
+	entryPool.destroy(entry);
+}
@@ -0,0 +1,79 @@
+#ifndef ISTRING_HPP
+#define ISTRING_HPP
+
+#include "Pool.hpp"
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Counters exported through STATS: "logical" is what the same strings
+// would cost if every holder kept its own copy
+struct InternStats
+{
+	size_t	entries;
+	size_t	references;
+	size_t	bytesStored;
+	size_t	bytesLogical;
+};
+
+// Handle to an interned, reference counted string. Every distinct value
+// (nick, user, host, channel name, casefolded registry key) is stored once
+// in a process wide table; handles share it and the entry is freed when
+// the last one goes away. Copying a handle is a counter increment and
+// equality is a pointer compare. Not thread safe: only the event loop
+// creates or drops handles.
+class IString
+{
+	private:
+		struct Entry
+		{
+			Entry		*next;	// Hash chain
+			size_t		hash;
+			size_t		refs;
+			std::string	text;
+
+			Entry(const std::string &text, size_t hash);
+		};
+
+		Entry	*entry;	// NULL for the empty string
+
+		static std::vector<Entry*>	buckets;
+		static size_t				entryCount;
+		static InternStats			stats;
+		static ObjectPool<Entry>	entryPool;
+
+		static size_t	hashText(const char *data, size_t len);
+		static Entry*	intern(const char *data, size_t len);
+		static void		grow();
+
+		void	retain();
+		void	release();
+
+	public:
+		// Constructor
+		IString();
+		explicit IString(const std::string &text);
+		IString(const char *data, size_t len);
+		IString(const IString &other);
+
+		// Destructor
+		~IString();
+
+		IString&	operator=(const IString &other);
+		bool		operator==(const IString &other) const;
+		bool		operator!=(const IString &other) const;
+
+		// Getter
+		const std::string&	str() const;
+		size_t				size() const;
+		bool				empty() const;
+		static InternStats	getStats();
+		static const PoolStats&	getPoolStats();
+
+		// Utilities
+		void	swap(IString &other);
+		void	clear();
+};
+
+#endif
@@ -0,0 +1,191 @@
+#include "Logger.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+
+Logger::Record	Logger::ring[Logger::ringSize];
+size_t			Logger::head = 0;
+size_t			Logger::tail = 0;
+size_t			Logger::dropped = 0;
+std::time_t		Logger::now = 0;
+bool			Logger::running = false;
+pthread_t		Logger::writer;
+pthread_mutex_t	Logger::wakeLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t	Logger::wakeup = PTHREAD_COND_INITIALIZER;
+
+static const char	*levelTags[] = { "DEBUG: ", "", "WARN: ", "ERROR: " };
+
+// Lifecycle
+void	Logger::start()
+{
+	if (running)
+		return ;
+
+	tick();
+	__atomic_store_n(&running, true, __ATOMIC_RELEASE);
+	if (pthread_create(&writer, NULL, &Logger::writerMain, NULL) != 0)
+		__atomic_store_n(&running, false, __ATOMIC_RELEASE);
+}
+
+void	Logger::stop()
+{
+	if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE))
+		return ;
+
+	__atomic_store_n(&running, false, __ATOMIC_SEQ_CST);
+	wake();
+	pthread_join(writer, NULL);
+}
+
+void	Logger::tick()
+{
+	now = std::time(NULL);
+}
+
+// Producer side (event loop)
+void	Logger::write(int level, const std::string &msg)
+{
+	write(level, msg.data(), msg.size());
+}
+
+void	Logger::write(int level, const char *msg, size_t len)
+{
+	if (len > textSize)
+		len = textSize;
+
+	// Writer thread not running: fall back to a synchronous write
+	if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE))
+	{
+		Record	rec;
+		char	line[textSize + 64];
+
+		rec.when = now ? now : std::time(NULL);
+		rec.level = static_cast<unsigned char>(level);
+		rec.len = static_cast<unsigned short>(len);
+		std::memcpy(rec.text, msg, len);
+		flush(line, format(rec, line, sizeof(line)));
+		return ;
+	}
+
+	size_t	h = head;
+	size_t	t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+
+	if (h - t == ringSize)
+	{
+		__atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+		return ;
+	}
+
+	Record	&rec = ring[h & (ringSize - 1)];
+
+	rec.when = now;
+	rec.level = static_cast<unsigned char>(level);
+	rec.len = static_cast<unsigned short>(len);
+	std::memcpy(rec.text, msg, len);
+
+	// Publish, then look at tail again: if the writer had already caught
+	// up, it may be about to sleep and must be woken for this record
+	__atomic_store_n(&head, h + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&tail, __ATOMIC_SEQ_CST) == h)
+		wake();
+}
+
+void	Logger::wake()
+{
+	pthread_mutex_lock(&wakeLock);
+	pthread_cond_signal(&wakeup);
+	pthread_mutex_unlock(&wakeLock);
+}
+
+// Consumer side (writer thread)
+void*	Logger::writerMain(void *arg)
+{
+	char	batch[16384];
+
+	(void)arg;
+	while (__atomic_load_n(&running, __ATOMIC_ACQUIRE))
+	{
+		size_t len = drain(batch, sizeof(batch));
+
+		if (len)
+		{
+			flush(batch, len);
+			continue ;
+		}
+
+		pthread_mutex_lock(&wakeLock);
+		while (__atomic_load_n(&running, __ATOMIC_SEQ_CST)
+			&& __atomic_load_n(&head, __ATOMIC_SEQ_CST) == tail)
+			pthread_cond_wait(&wakeup, &wakeLock);
+		pthread_mutex_unlock(&wakeLock);
+	}
+
+	// Final drain after stop()
+	size_t len;
+	while ((len = drain(batch, sizeof(batch))) != 0)
+		flush(batch, len);
+
+	return (NULL);
+}
+
+size_t	Logger::drain(char *out, size_t cap)
+{
+	size_t	used = 0;
+	size_t	t = tail;
+	size_t	h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	size_t	lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+
+	if (lost)
+	{
+		int n = std::snprintf(out, cap, "[logger] %lu records dropped\n",
+								static_cast<unsigned long>(lost));
+		if (n > 0)
+			used = static_cast<size_t>(n);
+	}
+
+	while (t != h && cap - used >= textSize + 64)
+	{
+		used += format(ring[t & (ringSize - 1)], out + used, cap - used);
+		++t;
+	}
+
+	__atomic_store_n(&tail, t, __ATOMIC_SEQ_CST);
+	return (used);
+}
+
+size_t	Logger::format(const Record &rec, char *out, size_t cap)
+{
+	static std::time_t	lastWhen = -1;
+	static char			stamp[20];
+
+	// Records of the same second share one strftime()
+	if (rec.when != lastWhen)
+	{
+		struct tm	tmv;
+
+		localtime_r(&rec.when, &tmv);
+		std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tmv);
+		lastWhen = rec.when;
+	}
+
+	int n = std::snprintf(out, cap, "[%s] %s%.*s\n", stamp,
+				levelTags[rec.level & 3], static_cast<int>(rec.len), rec.text);
+
+	if (n < 0)
+		return (0);
+	return (static_cast<size_t>(n) < cap ? static_cast<size_t>(n) : cap - 1);
+}
+
+void	Logger::flush(const char *data, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = ::write(STDOUT_FILENO, data, len);
+
+		if (n <= 0)
+			return ;
+		data += n;
+		len -= static_cast<size_t>(n);
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <string>
+#include <ctime>
+#include <cstddef>
+#include <pthread.h>
+
+// Log levels. Anything below LOG_LEVEL is compiled out, arguments included.
+#define LOG_LEVEL_DEBUG	0
+#define LOG_LEVEL_INFO	1
+#define LOG_LEVEL_WARN	2
+#define LOG_LEVEL_ERROR	3
+
+#ifndef LOG_LEVEL
+# define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+# define LOG_DEBUG(msg)	Logger::write(LOG_LEVEL_DEBUG, (msg))
+#else
+# define LOG_DEBUG(msg)	((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+# define LOG_INFO(msg)	Logger::write(LOG_LEVEL_INFO, (msg))
+#else
+# define LOG_INFO(msg)	((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+# define LOG_WARN(msg)	Logger::write(LOG_LEVEL_WARN, (msg))
+#else
+# define LOG_WARN(msg)	((void)0)
+#endif
+
+#define LOG_ERROR(msg)	Logger::write(LOG_LEVEL_ERROR, (msg))
+
+// Records are copied into a fixed single-producer/single-consumer ring by
+// the event loop and written to stdout by a background thread, so a slow
+// terminal or pipe never stalls poll(). When the ring is full the record
+// is dropped and counted instead of blocking. An idle writer sleeps on a
+// condition variable; the loop only signals it when a record lands in an
+// empty ring, so a busy ring costs no locking at all.
+class Logger
+{
+	private:
+		static const size_t	ringSize = 1024;	// Power of two
+		static const size_t	textSize = 240;
+
+		struct Record
+		{
+			std::time_t		when;
+			unsigned short	len;
+			unsigned char	level;
+			char			text[textSize];
+		};
+
+		static Record		ring[ringSize];
+		static size_t		head;		// Next slot written by the loop
+		static size_t		tail;		// Next slot read by the writer thread
+		static size_t		dropped;
+		static std::time_t	now;		// Cached once per loop tick
+		static bool			running;
+		static pthread_t	writer;
+		static pthread_mutex_t	wakeLock;
+		static pthread_cond_t	wakeup;		// Ring went from empty to non-empty
+
+		Logger(); // Block default constructor
+
+		static void*	writerMain(void *arg);
+		static size_t	drain(char *out, size_t cap);
+		static size_t	format(const Record &rec, char *out, size_t cap);
+		static void		flush(const char *data, size_t len);
+		static void		wake();
+
+	public:
+		// Lifecycle
+		static void	start();
+		static void	stop();
+
+		// Refresh the cached timestamp, called once per loop iteration
+		static void	tick();
+
+		static void	write(int level, const std::string &msg);
+		static void	write(int level, const char *msg, size_t len);
+};
+
+#endif
@@ -0,0 +1,332 @@
+#include "MaskSet.hpp"
+#include "Client.hpp"
+#include "CaseMap.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+std::map<std::string, MaskSet*>	MaskSet::registry;
+unsigned int					MaskSet::nextSerial = 1;
+
+// ------------- MatchCache -----------//
+
+// Constructor
+MatchCache::MatchCache() : subjectVersion(0), hasSubject(false)
+{
+	for (size_t i = 0; i < MATCHCACHE_SLOTS; ++i)
+		slots[i].serial = 0;
+}
+
+// Utilities
+bool	MatchCache::lookup(unsigned int serial, unsigned int version,
+			bool &matched) const
+{
+	const Slot &slot = slots[serial % MATCHCACHE_SLOTS];
+
+	if (slot.serial != serial || slot.version != version)
+		return (false);
+	matched = slot.matched;
+	return (true);
+}
+
+void	MatchCache::store(unsigned int serial, unsigned int version, bool matched)
+{
+	Slot &slot = slots[serial % MATCHCACHE_SLOTS];
+
+	slot.serial = serial;
+	slot.version = version;
+	slot.matched = matched;
+}
+
+const std::string&	MatchCache::foldedSubject(const Client &client)
+{
+	if (!hasSubject || subjectVersion != client.getPrefixVersion())
+	{
+		subject = CaseMap::fold(client.getPrefix());
+		if (!subject.empty() && subject[0] == ':')
+			subject.erase(0, 1);
+		subjectVersion = client.getPrefixVersion();
+		hasSubject = true;
+	}
+	return (subject);
+}
+
+// ------------- MaskSet -----------//
+
+static bool	byFolded(const std::pair<std::string, std::string> &a,
+				const std::pair<std::string, std::string> &b)
+{
+	return (a.first < b.first);
+}
+
+bool	MaskSet::Bucket::operator<(const Bucket &other) const
+{
+	return (key < other.key);
+}
+
+// Constructor: masks must already be sorted by folded text and unique
+MaskSet::MaskSet(const std::vector<std::string> &masks) : masks(masks),
+	serial(nextSerial++), refs(0)
+{
+	if (nextSerial == 0)
+		nextSerial = 1;
+
+	patterns.resize(masks.size());
+	for (size_t i = 0; i < masks.size(); ++i)
+	{
+		Pattern		&p = patterns[i];
+		size_t		first;
+
+		p.text = CaseMap::fold(masks[i]);
+		first = p.text.find_first_of("*?");
+		if (first == std::string::npos)
+		{
+			p.prefixLen = p.text.size();
+			p.suffixLen = 0;
+		}
+		else
+		{
+			p.prefixLen = first;
+			p.suffixLen = p.text.size() - 1 - p.text.find_last_of("*?");
+		}
+
+		Bucket	b;
+
+		b.index = static_cast<unsigned int>(i);
+		if (p.prefixLen)
+		{
+			b.key = static_cast<unsigned char>(p.text[0]);
+			byPrefix.push_back(b);
+		}
+		else if (p.suffixLen)
+		{
+			b.key = static_cast<unsigned char>(p.text[p.text.size() - 1]);
+			bySuffix.push_back(b);
+		}
+		else
+			floating.push_back(b.index);
+
+		if (i)
+			canonical += ' ';
+		canonical += p.text;
+	}
+	std::stable_sort(byPrefix.begin(), byPrefix.end());
+	std::stable_sort(bySuffix.begin(), bySuffix.end());
+}
+
+// Getter
+size_t	MaskSet::size() const
+{
+	return (masks.size());
+}
+
+const std::vector<std::string>&	MaskSet::getMasks() const
+{
+	return (masks);
+}
+
+unsigned int	MaskSet::getSerial() const
+{
+	return (serial);
+}
+
+bool	MaskSet::contains(const std::string &mask) const
+{
+	std::string	folded = CaseMap::fold(mask);
+	size_t		first = 0;
+	size_t		len = patterns.size();
+
+	while (len > 0)
+	{
+		size_t step = len / 2;
+
+		if (patterns[first + step].text < folded)
+		{
+			first += step + 1;
+			len -= step + 1;
+		}
+		else
+			len = step;
+	}
+	return (first < patterns.size() && patterns[first].text == folded);
+}
+
+size_t	MaskSet::getSharedCount()
+{
+	return (registry.size());
+}
+
+// Utilities
+bool	MaskSet::matches(const std::string &subject) const
+{
+	if (subject.empty())
+		return (false);
+	if (scan(byPrefix, static_cast<unsigned char>(subject[0]), subject))
+		return (true);
+	if (scan(bySuffix, static_cast<unsigned char>(subject[subject.size() - 1]), subject))
+		return (true);
+	for (size_t i = 0; i < floating.size(); ++i)
+	{
+		if (matchPattern(patterns[floating[i]], subject))
+			return (true);
+	}
+	return (false);
+}
+
+bool	MaskSet::matches(const Client &client) const
+{
+	MatchCache	&cache = client.getMatchCache();
+	bool		matched;
+
+	if (cache.lookup(serial, client.getPrefixVersion(), matched))
+		return (matched);
+	matched = matches(cache.foldedSubject(client));
+	cache.store(serial, client.getPrefixVersion(), matched);
+	return (matched);
+}
+
+bool	MaskSet::scan(const std::vector<Bucket> &buckets, unsigned char key,
+			const std::string &subject) const
+{
+	Bucket	probe;
+
+	probe.key = key;
+	probe.index = 0;
+
+	std::vector<Bucket>::const_iterator it
+		= std::lower_bound(buckets.begin(), buckets.end(), probe);
+
+	for (; it != buckets.end() && it->key == key; ++it)
+	{
+		if (matchPattern(patterns[it->index], subject))
+			return (true);
+	}
+	return (false);
+}
+
+bool	MaskSet::matchPattern(const Pattern &pattern, const std::string &subject)
+{
+	size_t	n = subject.size();
+
+	if (n < pattern.prefixLen + pattern.suffixLen)
+		return (false);
+	if (std::memcmp(pattern.text.data(), subject.data(), pattern.prefixLen) != 0)
+		return (false);
+	if (std::memcmp(pattern.text.data() + pattern.text.size() - pattern.suffixLen,
+			subject.data() + n - pattern.suffixLen, pattern.suffixLen) != 0)
+		return (false);
+	return (glob(pattern.text.data() + pattern.prefixLen,
+		pattern.text.size() - pattern.prefixLen - pattern.suffixLen,
+		subject.data() + pattern.prefixLen,
+		n - pattern.prefixLen - pattern.suffixLen));
+}
+
+// '*' and '?' wildcards, backtracking to the last '*' only
+bool	MaskSet::glob(const char *pat, size_t patLen, const char *str, size_t strLen)
+{
+	size_t	p = 0;
+	size_t	s = 0;
+	size_t	starP = patLen;
+	size_t	starS = 0;
+
+	while (s < strLen)
+	{
+		if (p < patLen && (pat[p] == '?' || pat[p] == str[s]))
+		{
+			++p;
+			++s;
+		}
+		else if (p < patLen && pat[p] == '*')
+		{
+			starP = p++;
+			starS = s;
+		}
+		else if (starP != patLen)
+		{
+			p = starP + 1;
+			s = ++starS;
+		}
+		else
+			return (false);
+	}
+	while (p < patLen && pat[p] == '*')
+		++p;
+	return (p == patLen);
+}
+
+// Returns the shared set for masks (taking a reference), NULL if empty
+const MaskSet*	MaskSet::acquire(std::vector<std::string> &masks)
+{
+	if (masks.empty())
+		return (NULL);
+
+	std::vector<std::pair<std::string, std::string> >	keyed;
+
+	keyed.reserve(masks.size());
+	for (size_t i = 0; i < masks.size(); ++i)
+		keyed.push_back(std::make_pair(CaseMap::fold(masks[i]), masks[i]));
+	std::stable_sort(keyed.begin(), keyed.end(), byFolded);
+
+	std::string	canonical;
+
+	masks.clear();
+	for (size_t i = 0; i < keyed.size(); ++i)
+	{
+		if (i && keyed[i].first == keyed[i - 1].first)
+			continue ;
+		if (!canonical.empty())
+			canonical += ' ';
+		canonical += keyed[i].first;
+		masks.push_back(keyed[i].second);
+	}
+
+	std::map<std::string, MaskSet*>::iterator it = registry.find(canonical);
+
+	if (it == registry.end())
+		it = registry.insert(std::make_pair(canonical, new MaskSet(masks))).first;
+	++it->second->refs;
+	return (it->second);
+}
+
+const MaskSet*	MaskSet::replace(const MaskSet *base, std::vector<std::string> &masks)
+{
+	const MaskSet *set = acquire(masks);
+
+	release(base);
+	return (set);
+}
+
+void	MaskSet::release(const MaskSet *set)
+{
+	if (!set)
+		return ;
+
+	MaskSet *owned = const_cast<MaskSet*>(set);
+
+	if (--owned->refs > 0)
+		return ;
+	registry.erase(owned->canonical);
+	delete owned;
+}
+
+bool	MaskSet::matchMask(const std::string &mask, const std::string &subject)
+{
+	return (glob(mask.data(), mask.size(), subject.data(), subject.size()));
+}
+
+std::string	MaskSet::normalize(const std::string &mask)
+{
+	if (mask.empty())
+		return (mask);
+
+	size_t	bang = mask.find('!');
+	size_t	at = mask.find('@');
+
+	if (bang == std::string::npos && at == std::string::npos)
+		return (mask + "!*@*");
+	if (bang == std::string::npos)
+		return ("*!" + mask);
+	if (at == std::string::npos)
+		return (mask + "@*");
+	return (mask);
+}
@@ -0,0 +1,117 @@
+#ifndef MASKSET_HPP
+#define MASKSET_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+
+class Client;
+
+#define MATCHCACHE_SLOTS 8
+
+// Recent MaskSet results of one client, direct mapped by set serial.
+// Entries are stamped with the client's prefix version, so a nick or
+// host change makes every cached result miss without touching the cache.
+class MatchCache
+{
+	private:
+		struct Slot
+		{
+			unsigned int	serial;	// 0 = empty
+			unsigned int	version;
+			bool			matched;
+		};
+
+		Slot			slots[MATCHCACHE_SLOTS];
+		std::string		subject;	// Folded "nick!user@host"
+		unsigned int	subjectVersion;
+		bool			hasSubject;
+
+	public:
+		// Constructor
+		MatchCache();
+
+		// Utilities
+		bool				lookup(unsigned int serial, unsigned int version,
+								bool &matched) const;
+		void				store(unsigned int serial, unsigned int version,
+								bool matched);
+		const std::string&	foldedSubject(const Client &client);
+};
+
+// Immutable, compiled list of nick!user@host masks (a +b, +e or +I list).
+// Each mask is casefolded and split into a literal prefix, a literal
+// suffix and a wildcard middle. Masks are indexed by the first byte of
+// their prefix or, failing that, the last byte of their suffix, so a
+// lookup only runs the glob on masks that can possibly match. Sets are
+// interned by content and refcounted: channels with identical lists
+// share one compiled set, and its serial keys the per-client MatchCache.
+class MaskSet
+{
+	private:
+		struct Pattern
+		{
+			std::string	text;	// Folded mask
+			size_t		prefixLen;
+			size_t		suffixLen;
+		};
+
+		struct Bucket
+		{
+			unsigned char	key;
+			unsigned int	index;	// Into patterns
+
+			bool	operator<(const Bucket &other) const;
+		};
+
+		std::vector<std::string>	masks;		// As set, sorted by folded text
+		std::vector<Pattern>		patterns;
+		std::vector<Bucket>			byPrefix;	// Keyed by first prefix byte
+		std::vector<Bucket>			bySuffix;	// Keyed by last suffix byte
+		std::vector<unsigned int>	floating;	// Wildcards on both ends
+		std::string					canonical;	// Registry key
+		unsigned int				serial;
+		size_t						refs;
+
+		static std::map<std::string, MaskSet*>	registry;
+		static unsigned int						nextSerial;
+
+		MaskSet(); // Block default constructor
+		MaskSet(const MaskSet &other); // Block copy
+		MaskSet&	operator=(const MaskSet &other);
+
+		explicit MaskSet(const std::vector<std::string> &masks);
+
+		static const MaskSet*	acquire(std::vector<std::string> &masks);
+		static bool				matchPattern(const Pattern &pattern,
+									const std::string &subject);
+		static bool				glob(const char *pat, size_t patLen,
+									const char *str, size_t strLen);
+		bool					scan(const std::vector<Bucket> &buckets,
+									unsigned char key, const std::string &subject) const;
+
+	public:
+		// Getter
+		size_t								size() const;
+		const std::vector<std::string>&		getMasks() const;
+		unsigned int						getSerial() const;
+		bool								contains(const std::string &mask) const;
+
+		// Utilities
+		bool	matches(const std::string &subject) const;	// Folded subject
+		bool	matches(const Client &client) const;		// Cached per client
+
+		// Copy-on-write edit: release base, return the set for masks (which
+		// is sorted and deduplicated in place)
+		static const MaskSet*	replace(const MaskSet *base, std::vector<std::string> &masks);
+		static void				release(const MaskSet *set);
+
+		// "nick" -> "nick!*@*", "user@host" -> "*!user@host", ...
+		static std::string		normalize(const std::string &mask);
+		static bool				matchMask(const std::string &mask,
+									const std::string &subject);	// Both folded
+		static size_t			getSharedCount();
+};
+
+#endif
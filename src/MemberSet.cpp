@@ -0,0 +1,220 @@
+#include "MemberSet.hpp"
+
+#include <algorithm>
+
+static size_t	hashId(unsigned int id)
+{
+	return (static_cast<size_t>(id * 2654435761u));
+}
+
+static bool	byId(const MemberSet::Member &a, const MemberSet::Member &b)
+{
+	return (a.id < b.id);
+}
+
+// Constructor
+MemberSet::MemberSet() : count(0), hashed(false) {}
+
+// Getter
+size_t	MemberSet::size() const
+{
+	return (count);
+}
+
+bool	MemberSet::empty() const
+{
+	return (count == 0);
+}
+
+bool	MemberSet::isHashed() const
+{
+	return (hashed);
+}
+
+const MemberSet::Member*	MemberSet::data() const
+{
+	return (hashed ? &dense[0] : small);
+}
+
+const MemberSet::Member&	MemberSet::operator[](size_t i) const
+{
+	return (data()[i]);
+}
+
+// Utilities
+MemberSet::Member*	MemberSet::find(unsigned int id)
+{
+	if (!hashed)
+	{
+		size_t pos = lowerBound(id);
+
+		if (pos < count && small[pos].id == id)
+			return (&small[pos]);
+		return (NULL);
+	}
+
+	unsigned slot = index[locate(id)];
+	return (slot ? &dense[slot - 1] : NULL);
+}
+
+const MemberSet::Member*	MemberSet::find(unsigned int id) const
+{
+	return (const_cast<MemberSet*>(this)->find(id));
+}
+
+bool	MemberSet::insert(unsigned int id, unsigned int roles)
+{
+	Member	member;
+
+	member.id = id;
+	member.roles = roles;
+
+	if (!hashed)
+	{
+		size_t pos = lowerBound(id);
+
+		if (pos < count && small[pos].id == id)
+			return (false);
+		if (count < MEMBERSET_INLINE)
+		{
+			std::copy_backward(small + pos, small + count, small + count + 1);
+			small[pos] = member;
+			++count;
+			return (true);
+		}
+		promote();
+	}
+
+	if ((count + 1) * 2 > index.size())
+		rebuildIndex(index.size() * 2);
+
+	size_t slot = locate(id);
+
+	if (index[slot])
+		return (false);
+	dense.push_back(member);
+	index[slot] = static_cast<unsigned>(dense.size());
+	++count;
+	return (true);
+}
+
+bool	MemberSet::erase(unsigned int id)
+{
+	if (!hashed)
+	{
+		size_t pos = lowerBound(id);
+
+		if (pos == count || small[pos].id != id)
+			return (false);
+		std::copy(small + pos + 1, small + count, small + pos);
+		--count;
+		return (true);
+	}
+
+	size_t slot = locate(id);
+
+	if (!index[slot])
+		return (false);
+
+	size_t pos = index[slot] - 1;
+
+	eraseSlot(slot);
+	// Keep dense packed: the last member moves into the hole
+	if (pos != dense.size() - 1)
+	{
+		dense[pos] = dense.back();
+		index[locate(dense[pos].id)] = static_cast<unsigned>(pos + 1);
+	}
+	dense.pop_back();
+	--count;
+
+	if (count <= MEMBERSET_INLINE / 2)
+		demote();
+	return (true);
+}
+
+void	MemberSet::clear()
+{
+	count = 0;
+	hashed = false;
+	std::vector<Member>().swap(dense);
+	std::vector<unsigned>().swap(index);
+}
+
+size_t	MemberSet::lowerBound(unsigned int id) const
+{
+	size_t	first = 0;
+	size_t	len = count;
+
+	while (len > 0)
+	{
+		size_t step = len / 2;
+
+		if (small[first + step].id < id)
+		{
+			first += step + 1;
+			len -= step + 1;
+		}
+		else
+			len = step;
+	}
+	return (first);
+}
+
+// Slot holding id, or the empty slot ending its probe sequence
+size_t	MemberSet::locate(unsigned int id) const
+{
+	size_t mask = index.size() - 1;
+	size_t i = hashId(id) & mask;
+
+	while (index[i] && dense[index[i] - 1].id != id)
+		i = (i + 1) & mask;
+	return (i);
+}
+
+void	MemberSet::rebuildIndex(size_t slots)
+{
+	index.assign(slots, 0);
+	for (size_t i = 0; i < dense.size(); ++i)
+		index[locate(dense[i].id)] = static_cast<unsigned>(i + 1);
+}
+
+void	MemberSet::promote()
+{
+	dense.assign(small, small + count);
+	hashed = true;
+	rebuildIndex(MEMBERSET_INLINE * 4);
+}
+
+void	MemberSet::demote()
+{
+	std::sort(dense.begin(), dense.end(), byId);
+	std::copy(dense.begin(), dense.end(), small);
+	hashed = false;
+	std::vector<Member>().swap(dense);
+	std::vector<unsigned>().swap(index);
+}
+
+// Backward shift deletion, same scheme as HashRegistry
+void	MemberSet::eraseSlot(size_t slot)
+{
+	size_t mask = index.size() - 1;
+	size_t i = slot;
+	size_t j = slot;
+
+	while (true)
+	{
+		j = (j + 1) & mask;
+		if (!index[j])
+			break ;
+
+		size_t home = hashId(dense[index[j] - 1].id) & mask;
+		bool stays = (i <= j) ? (i < home && home <= j)
+							: (i < home || home <= j);
+		if (stays)
+			continue ;
+		index[i] = index[j];
+		i = j;
+	}
+	index[i] = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef MEMBERSET_HPP
+#define MEMBERSET_HPP
+
+#include <vector>
+#include <cstddef>
+
+#define MEMBERSET_INLINE 8
+
+// Channel membership keyed by client id. Small channels (the vast
+// majority) keep members sorted in an inline array and use binary search.
+// Past MEMBERSET_INLINE members the set switches to a dense vector plus
+// an open addressing id -> position index, and falls back to the inline
+// array once it shrinks to half of that. Either way members are stored
+// contiguously, so fanout is a linear walk over data()[0..size()).
+class MemberSet
+{
+	public:
+		struct Member
+		{
+			unsigned int	id;
+			unsigned int	roles;
+		};
+
+	private:
+		Member					small[MEMBERSET_INLINE];	// Sorted by id
+		size_t					count;
+		bool					hashed;
+		std::vector<Member>		dense;	// Unordered, hashed mode only
+		std::vector<unsigned>	index;	// Position in dense + 1, 0 = empty
+
+		MemberSet(const MemberSet &other); // Block copy
+		MemberSet&	operator=(const MemberSet &other);
+
+		size_t	lowerBound(unsigned int id) const;
+		size_t	locate(unsigned int id) const;
+		void	rebuildIndex(size_t slots);
+		void	promote();
+		void	demote();
+		void	eraseSlot(size_t slot);
+
+	public:
+		// Constructor
+		MemberSet();
+
+		// Getter
+		size_t			size() const;
+		bool			empty() const;
+		bool			isHashed() const;
+		const Member*	data() const;
+		const Member&	operator[](size_t i) const;
+
+		// Utilities
+		Member*			find(unsigned int id);
+		const Member*	find(unsigned int id) const;
+		bool			insert(unsigned int id, unsigned int roles);
+		bool			erase(unsigned int id);
+		void			clear();
+};
+
+#endif
@@ -0,0 +1,765 @@
+#include "MessageLog.hpp"
+#include "CaseMap.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Frame layout, little endian:
+//   0  magic "IRCL"     4  kind      6  source length   8  text length
+//   16 msgid            24 time (ms) 32 source, then text
+static const size_t		frameHeader = 32;
+static const size_t		segmentBytes = serverConfig::logRecordBytes
+										* serverConfig::logSegmentRecords;
+static const char		frameMagic[4] = { 'I', 'R', 'C', 'L' };
+
+static void	putWord(unsigned char *p, unsigned long value, size_t bytes)
+{
+	for (size_t i = 0; i < bytes; ++i)
+		p[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+
+static unsigned long	getWord(const unsigned char *p, size_t bytes)
+{
+	unsigned long	value = 0;
+
+	for (size_t i = bytes; i > 0; --i)
+		value = (value << 8) | p[i - 1];
+	return (value);
+}
+
+static std::string	hexName(const std::string &text)
+{
+	static const char	digits[] = "0123456789abcdef";
+	std::string			out;
+
+	out.reserve(text.size() * 2);
+	for (size_t i = 0; i < text.size(); ++i)
+	{
+		unsigned char c = static_cast<unsigned char>(text[i]);
+
+		out += digits[c >> 4];
+		out += digits[c & 15];
+	}
+	return (out);
+}
+
+static bool	unhexName(const std::string &hex, std::string &out)
+{
+	if (hex.empty() || hex.size() % 2)
+		return (false);
+	out.clear();
+	for (size_t i = 0; i < hex.size(); i += 2)
+	{
+		char	*end;
+		char	pair[3] = { hex[i], hex[i + 1], '\0' };
+		long	c = std::strtol(pair, &end, 16);
+
+		if (*end)
+			return (false);
+		out += static_cast<char>(c);
+	}
+	return (true);
+}
+
+// Constructor
+MessageLog::MessageLog(const std::string &path) : path(path), records(0),
+	mappedCount(0), readClock(0), queue(NULL), head(0), tail(0), dropped(0), syncs(0), errors(0),
+	running(false), openCount(0), writeClock(0)
+{
+	pthread_mutex_init(&wakeLock, NULL);
+	pthread_cond_init(&wakeup, NULL);
+}
+
+// Destructor
+MessageLog::~MessageLog()
+{
+	close();
+	for (LogMap::iterator it = logs.begin(); it != logs.end(); ++it)
+	{
+		std::vector<Segment> &segments = it->second->segments;
+
+		for (size_t i = 0; i < segments.size(); ++i)
+		{
+			if (segments[i].map)
+				munmap(const_cast<unsigned char*>(segments[i].map), segmentBytes);
+		}
+		delete it->second;
+	}
+	delete[] queue;
+	pthread_cond_destroy(&wakeup);
+	pthread_mutex_destroy(&wakeLock);
+}
+
+// Getter
+LogStats	MessageLog::getStats() const
+{
+	LogStats	st = { logs.size(), 0, mappedCount, serverConfig::logMaxMappedSegments,
+		records,
+		__atomic_load_n(&dropped, __ATOMIC_RELAXED),
+		__atomic_load_n(&syncs, __ATOMIC_RELAXED),
+		__atomic_load_n(&errors, __ATOMIC_RELAXED) };
+
+	for (LogMap::const_iterator it = logs.begin(); it != logs.end(); ++it)
+		st.segments += it->second->segments.size();
+	return (st);
+}
+
+// Lifecycle
+unsigned long	MessageLog::open()
+{
+	unsigned long	maxId = 0;
+
+	if (running)
+		return (maxId);
+	if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+		return (maxId);
+
+	DIR	*top = opendir(path.c_str());
+
+	if (top)
+	{
+		// Newest generation of each channel name
+		std::map<std::string, std::pair<unsigned long, std::string> >	newest;
+		struct dirent	*entry;
+		std::string		key;
+
+		while ((entry = readdir(top)) != NULL)
+		{
+			std::string	name = entry->d_name;
+			size_t		dash = name.find('-');
+			char		*end;
+
+			if (name[0] == '.' || dash == std::string::npos
+				|| !unhexName(name.substr(0, dash), key))
+				continue ;
+
+			unsigned long	generation = std::strtoul(name.c_str() + dash + 1, &end, 10);
+
+			if (*end || end == name.c_str() + dash + 1)
+				continue ;
+			if (!newest.count(key) || newest[key].first < generation)
+				newest[key] = std::make_pair(generation, name);
+		}
+		closedir(top);
+		for (std::map<std::string, std::pair<unsigned long, std::string> >::iterator
+			it = newest.begin(); it != newest.end(); ++it)
+			recover(it->second.second, it->first, maxId);
+	}
+
+	queue = new Pending[queueSize];
+	__atomic_store_n(&running, true, __ATOMIC_RELEASE);
+	if (pthread_create(&writer, NULL, &MessageLog::writerMain, this) != 0)
+		__atomic_store_n(&running, false, __ATOMIC_RELEASE);
+	return (maxId);
+}
+
+void	MessageLog::close()
+{
+	if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE))
+		return ;
+
+	__atomic_store_n(&running, false, __ATOMIC_SEQ_CST);
+	wake();
+	pthread_join(writer, NULL);
+}
+
+// Rebuilds the sparse index of every segment of one channel. Frames the
+// writer never got to (queue drops, crash) read as holes and are skipped;
+// a hole can span whole strides, so every frame of the segment is looked
+// at and the last valid one sets the frame count.
+void	MessageLog::recover(const std::string &dir, const std::string &key,
+			unsigned long &maxId)
+{
+	DIR	*sub = opendir((path + "/" + dir).c_str());
+
+	if (!sub)
+		return ;
+
+	std::vector<unsigned long>	ids;
+	struct dirent				*entry;
+
+	while ((entry = readdir(sub)) != NULL)
+	{
+		const char	*name = entry->d_name;
+		char		*end;
+		unsigned long id = std::strtoul(name, &end, 10);
+
+		if (end != name && std::strcmp(end, ".seg") == 0)
+			ids.push_back(id);
+	}
+	closedir(sub);
+	std::sort(ids.begin(), ids.end());
+
+	ChannelLog	*log = new ChannelLog();
+
+	log->dir = dir;
+	for (size_t i = 0; i < ids.size(); ++i)
+	{
+		Segment	seg;
+
+		seg.firstId = ids[i];
+		seg.count = 0;
+		seg.sealed = true;
+		seg.map = NULL;
+		seg.used = 0;
+		if (!mapSegment(*log, seg))
+			continue ;
+
+		// Index the first valid frame of each stride
+		const size_t	stride = serverConfig::logIndexStride;
+
+		for (size_t slot = 0; slot < serverConfig::logSegmentRecords; ++slot)
+		{
+			IndexEntry	e;
+
+			if (!readKey(*log, seg, slot, false, e.id))
+				continue ;
+			if (seg.index.empty() || seg.index.back().slot / stride != slot / stride)
+			{
+				readKey(*log, seg, slot, true, e.time);
+				e.slot = slot;
+				seg.index.push_back(e);
+			}
+			seg.count = slot + 1;
+			maxId = std::max(maxId, e.id);
+		}
+		unmapSegment(seg);
+		if (seg.index.empty())
+			continue ;
+		records += seg.count;
+		log->segments.push_back(seg);
+	}
+	if (log->segments.empty())
+	{
+		delete log;
+		return ;
+	}
+	logs[key] = log;
+}
+
+// Reads (event loop)
+void	MessageLog::before(const std::string &channel,
+			const HistoryStore::Anchor &anchor, size_t limit,
+			std::vector<HistoryStore::Record> &out) const
+{
+	ChannelLog *log = findLog(channel);
+
+	if (!log || !limit)
+		return ;
+
+	Position	pos = locate(*log, anchor, true);
+	size_t		first = out.size();
+
+	if (pos.segment == log->segments.size())
+	{
+		--pos.segment;
+		pos.slot = log->segments[pos.segment].count;
+	}
+	while (out.size() - first < limit)
+	{
+		if (pos.slot == 0
+			|| !mapSegment(*log, log->segments[pos.segment]))
+		{
+			if (pos.segment == 0)
+				break ;
+			--pos.segment;
+			pos.slot = log->segments[pos.segment].count;
+			continue ;
+		}
+		--pos.slot;
+
+		HistoryStore::Record	record;
+
+		if (readRecord(*log, log->segments[pos.segment], pos.slot, record))
+			out.push_back(record);
+	}
+	std::reverse(out.begin() + first, out.end());
+}
+
+void	MessageLog::after(const std::string &channel,
+			const HistoryStore::Anchor &anchor, size_t limit,
+			std::vector<HistoryStore::Record> &out) const
+{
+	ChannelLog *log = findLog(channel);
+
+	if (!log)
+		return ;
+
+	Position	pos = locate(*log, anchor, false);
+	size_t		first = out.size();
+
+	while (out.size() - first < limit && pos.segment < log->segments.size())
+	{
+		Segment	&seg = log->segments[pos.segment];
+
+		if (pos.slot >= seg.count || !mapSegment(*log, seg))
+		{
+			++pos.segment;
+			pos.slot = 0;
+			continue ;
+		}
+
+		HistoryStore::Record	record;
+
+		if (readRecord(*log, seg, pos.slot++, record))
+			out.push_back(record);
+	}
+}
+
+MessageLog::ChannelLog*	MessageLog::findLog(const std::string &channel) const
+{
+	LogMap::const_iterator it = logs.find(CaseMap::fold(channel));
+
+	return (it == logs.end() ? NULL : it->second);
+}
+
+// First frame whose key is >= anchor (inclusive) or > anchor. Segments
+// and index entries are searched by their first key, so only one stride
+// of frames is ever read.
+MessageLog::Position	MessageLog::locate(ChannelLog &log,
+							const HistoryStore::Anchor &anchor, bool inclusive) const
+{
+	Position				pos = { 0, 0 };
+	std::vector<Segment>	&segments = log.segments;
+
+	// Last segment, then last index entry, starting below the anchor
+	for (size_t lo = 0, hi = segments.size(); lo < hi; )
+	{
+		size_t				mid = (lo + hi) / 2;
+		const IndexEntry	&e = segments[mid].index.front();
+		unsigned long		key = anchor.byTime ? e.time : e.id;
+
+		if (key < anchor.value || (!inclusive && key == anchor.value))
+		{
+			pos.segment = mid;
+			lo = mid + 1;
+		}
+		else
+			hi = mid;
+	}
+	if (segments.empty())
+		return (pos);
+
+	Segment					&seg = segments[pos.segment];
+	std::vector<IndexEntry>	&index = seg.index;
+	size_t					start = 0;
+
+	for (size_t lo = 0, hi = index.size(); lo < hi; )
+	{
+		size_t			mid = (lo + hi) / 2;
+		unsigned long	key = anchor.byTime ? index[mid].time : index[mid].id;
+
+		if (key < anchor.value || (!inclusive && key == anchor.value))
+		{
+			start = index[mid].slot;
+			lo = mid + 1;
+		}
+		else
+			hi = mid;
+	}
+
+	for (pos.slot = start; pos.slot < seg.count; ++pos.slot)
+	{
+		unsigned long	key;
+
+		if (!readKey(log, seg, pos.slot, anchor.byTime, key))
+			continue ;
+		if (key > anchor.value || (inclusive && key == anchor.value))
+			return (pos);
+	}
+	++pos.segment;
+	pos.slot = 0;
+	return (pos);
+}
+
+bool	MessageLog::mapSegment(const ChannelLog &log, Segment &seg) const
+{
+	seg.used = ++readClock;
+	if (seg.map)
+		return (true);
+	if (mappedCount >= serverConfig::logMaxMappedSegments)
+		evictMapping(seg);
+
+	int			fd = ::open(segmentPath(log.dir, seg.firstId).c_str(), O_RDONLY);
+	struct stat	st;
+
+	if (fd < 0)
+		return (false);
+	if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < segmentBytes)
+	{
+		::close(fd);
+		return (false);
+	}
+
+	void *map = mmap(NULL, segmentBytes, PROT_READ, MAP_SHARED, fd, 0);
+
+	::close(fd);
+	if (map == MAP_FAILED)
+		return (false);
+	seg.map = static_cast<const unsigned char*>(map);
+	++mappedCount;
+	return (true);
+}
+
+void	MessageLog::unmapSegment(Segment &seg) const
+{
+	if (!seg.map)
+		return ;
+	munmap(const_cast<unsigned char*>(seg.map), segmentBytes);
+	seg.map = NULL;
+	--mappedCount;
+}
+
+// Unmaps the least recently read segment other than keep. Walks every
+// segment, but only when a read misses the mappings already held.
+void	MessageLog::evictMapping(const Segment &keep) const
+{
+	Segment	*oldest = NULL;
+
+	for (LogMap::const_iterator it = logs.begin(); it != logs.end(); ++it)
+	{
+		std::vector<Segment> &segments = it->second->segments;
+
+		for (size_t i = 0; i < segments.size(); ++i)
+		{
+			Segment	&seg = segments[i];
+
+			if (seg.map && &seg != &keep && (!oldest || seg.used < oldest->used))
+				oldest = &seg;
+		}
+	}
+	if (oldest)
+		unmapSegment(*oldest);
+}
+
+bool	MessageLog::readKey(const ChannelLog &log, Segment &seg, size_t slot,
+			bool byTime, unsigned long &key) const
+{
+	if (!mapSegment(log, seg))
+		return (false);
+
+	const unsigned char *frame = seg.map + slot * serverConfig::logRecordBytes;
+
+	if (std::memcmp(frame, frameMagic, sizeof(frameMagic)) != 0)
+		return (false);
+	key = getWord(frame + (byTime ? 24 : 16), 8);
+	return (true);
+}
+
+bool	MessageLog::readRecord(const ChannelLog &log, Segment &seg, size_t slot,
+			HistoryStore::Record &out) const
+{
+	if (!readKey(log, seg, slot, false, out.id))
+		return (false);
+
+	const unsigned char	*frame = seg.map + slot * serverConfig::logRecordBytes;
+	size_t				sourceLen = getWord(frame + 6, 2);
+	size_t				textLen = getWord(frame + 8, 2);
+	const char			*payload = reinterpret_cast<const char*>(frame + frameHeader);
+
+	if (frameHeader + sourceLen + textLen > serverConfig::logRecordBytes)
+		return (false);
+	out.kind = frame[4];
+	out.time = getWord(frame + 24, 8);
+	out.source = IString(payload, sourceLen);
+	out.text = IString(payload + sourceLen, textLen);
+	return (true);
+}
+
+// Utilities
+void	MessageLog::append(const std::string &channel, const HistoryStore::Record &record)
+{
+	if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)
+		|| channel.size() > serverConfig::channelNameLen)
+		return ;
+
+	std::string	key = CaseMap::fold(channel);
+	ChannelLog	*&log = logs[key];
+
+	if (!log)
+	{
+		char	generation[24];
+
+		std::snprintf(generation, sizeof(generation), "-%lu", record.id);
+		log = new ChannelLog();
+		log->dir = hexName(key) + generation;
+	}
+
+	std::vector<Segment>	&segments = log->segments;
+
+	if (segments.empty() || segments.back().sealed
+		|| segments.back().count == serverConfig::logSegmentRecords)
+	{
+		Segment	seg;
+
+		seg.firstId = record.id;
+		seg.count = 0;
+		seg.sealed = false;
+		seg.map = NULL;
+		seg.used = 0;
+		segments.push_back(seg);
+	}
+
+	Segment	&seg = segments.back();
+	size_t	slot = seg.count++;
+
+	if (slot % serverConfig::logIndexStride == 0)
+	{
+		IndexEntry	e = { record.id, record.time, slot };
+
+		seg.index.push_back(e);
+	}
+	++records;
+
+	size_t	h = head;
+	size_t	t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+
+	if (h - t == queueSize)
+	{
+		__atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+		return ;
+	}
+
+	Pending			&item = queue[h & (queueSize - 1)];
+	size_t			sourceLen = record.source.size();
+	size_t			textLen = record.text.size();
+	const size_t	room = serverConfig::logRecordBytes - frameHeader;
+
+	if (sourceLen > room)
+		sourceLen = room;
+	if (textLen > room - sourceLen)
+		textLen = room - sourceLen;
+
+	std::memcpy(item.dir, log->dir.c_str(), log->dir.size() + 1);
+	item.segment = seg.firstId;
+	item.slot = slot;
+	std::memset(item.frame, 0, frameHeader);
+	std::memcpy(item.frame, frameMagic, sizeof(frameMagic));
+	item.frame[4] = record.kind;
+	putWord(item.frame + 6, sourceLen, 2);
+	putWord(item.frame + 8, textLen, 2);
+	putWord(item.frame + 16, record.id, 8);
+	putWord(item.frame + 24, record.time, 8);
+	std::memcpy(item.frame + frameHeader, record.source.str().data(), sourceLen);
+	std::memcpy(item.frame + frameHeader + sourceLen, record.text.str().data(), textLen);
+	std::memset(item.frame + frameHeader + sourceLen + textLen, 0,
+		room - sourceLen - textLen);
+
+	// Publish, then wake the writer if it had drained everything before
+	// this frame and may be about to sleep
+	__atomic_store_n(&head, h + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&tail, __ATOMIC_SEQ_CST) == h)
+		wake();
+}
+
+// The channel is gone: drop its log from the read side. Frames already
+// queued still reach the disk; the next creation opens a new generation.
+void	MessageLog::retire(const std::string &channel)
+{
+	LogMap::iterator	it = logs.find(CaseMap::fold(channel));
+
+	if (it == logs.end())
+		return ;
+
+	std::vector<Segment> &segments = it->second->segments;
+
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		unmapSegment(segments[i]);
+		records -= segments[i].count;
+	}
+	delete it->second;
+	logs.erase(it);
+}
+
+std::string	MessageLog::segmentPath(const std::string &dir, unsigned long segment) const
+{
+	char	name[32];
+
+	std::snprintf(name, sizeof(name), "/%020lu.seg", segment);
+	return (path + "/" + dir + name);
+}
+
+// Writer thread: never logs (the log ring has a single producer, the
+// event loop)
+void*	MessageLog::writerMain(void *arg)
+{
+	MessageLog		*self = static_cast<MessageLog*>(arg);
+	unsigned long	lastSync = Utils::nowMillis();
+
+	while (__atomic_load_n(&self->running, __ATOMIC_ACQUIRE))
+	{
+		bool			wrote = self->drain();
+		unsigned long	now = Utils::nowMillis();
+
+		if (now - lastSync >= serverConfig::logSyncMillis)
+		{
+			self->syncAll(false);
+			lastSync = now;
+		}
+		if (!wrote)
+			self->waitForFrames(lastSync + serverConfig::logSyncMillis);
+	}
+
+	// Final drain and commit after close()
+	while (self->drain())
+		;
+	self->syncAll(true);
+	return (NULL);
+}
+
+void	MessageLog::wake()
+{
+	pthread_mutex_lock(&wakeLock);
+	pthread_cond_signal(&wakeup);
+	pthread_mutex_unlock(&wakeLock);
+}
+
+// Sleeps until the queue is non-empty, close() is called, or deadline
+// (Utils::nowMillis() time, the next group commit) passes
+void	MessageLog::waitForFrames(unsigned long deadline)
+{
+	struct timespec	until;
+
+	until.tv_sec = static_cast<time_t>(deadline / 1000);
+	until.tv_nsec = static_cast<long>(deadline % 1000) * 1000000;
+
+	pthread_mutex_lock(&wakeLock);
+	while (__atomic_load_n(&running, __ATOMIC_SEQ_CST)
+		&& __atomic_load_n(&head, __ATOMIC_SEQ_CST) == tail)
+	{
+		if (pthread_cond_timedwait(&wakeup, &wakeLock, &until) != 0)
+			break ;
+	}
+	pthread_mutex_unlock(&wakeLock);
+}
+
+bool	MessageLog::drain()
+{
+	size_t	t = tail;
+	size_t	h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+
+	if (t == h)
+		return (false);
+	while (t != h)
+	{
+		writeFrame(queue[t & (queueSize - 1)]);
+		++t;
+		__atomic_store_n(&tail, t, __ATOMIC_SEQ_CST);
+	}
+	return (true);
+}
+
+void	MessageLog::writeFrame(const Pending &item)
+{
+	std::map<std::string, OpenSegment>::iterator it = openSegments.find(item.dir);
+
+	if (it == openSegments.end())
+	{
+		OpenSegment	none = { 0, -1, false, 0 };
+
+		it = openSegments.insert(std::make_pair(std::string(item.dir), none)).first;
+	}
+
+	OpenSegment	&open = it->second;
+
+	if (open.fd >= 0 && open.segment != item.segment)
+		closeSegment(open);
+	if (open.fd < 0)
+	{
+		std::string	dir = path + "/" + item.dir;
+		struct stat	st;
+
+		if (openCount >= serverConfig::logMaxOpenSegments)
+			evictSegment();
+		mkdir(dir.c_str(), 0755);
+		open.segment = item.segment;
+		open.dirty = false;
+		open.fd = ::open(segmentPath(item.dir, item.segment).c_str(),
+			O_RDWR | O_CREAT, 0644);
+		if (open.fd < 0 || fstat(open.fd, &st) != 0
+			|| (static_cast<size_t>(st.st_size) < segmentBytes
+				&& ftruncate(open.fd, segmentBytes) != 0))
+		{
+			if (open.fd >= 0)
+				::close(open.fd);
+			open.fd = -1;
+			__atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+			return ;
+		}
+		++openCount;
+	}
+
+	ssize_t	n = pwrite(open.fd, item.frame, serverConfig::logRecordBytes,
+				static_cast<off_t>(item.slot * serverConfig::logRecordBytes));
+
+	if (n != static_cast<ssize_t>(serverConfig::logRecordBytes))
+		__atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+	open.dirty = true;
+	open.used = ++writeClock;
+}
+
+void	MessageLog::closeSegment(OpenSegment &open)
+{
+	if (open.fd < 0)
+		return ;
+	if (open.dirty)
+	{
+		fdatasync(open.fd);
+		__atomic_add_fetch(&syncs, 1, __ATOMIC_RELAXED);
+	}
+	::close(open.fd);
+	open.fd = -1;
+	open.dirty = false;
+	--openCount;
+}
+
+// Closes the least recently written segment. A linear walk, but only on
+// the open path and bounded by logMaxOpenSegments live fds.
+void	MessageLog::evictSegment()
+{
+	std::map<std::string, OpenSegment>::iterator	it;
+	std::map<std::string, OpenSegment>::iterator	oldest = openSegments.end();
+
+	for (it = openSegments.begin(); it != openSegments.end(); ++it)
+	{
+		if (it->second.fd >= 0
+			&& (oldest == openSegments.end() || it->second.used < oldest->second.used))
+			oldest = it;
+	}
+	if (oldest != openSegments.end())
+		closeSegment(oldest->second);
+}
+
+// Group commit: one fdatasync per segment written since the last one
+void	MessageLog::syncAll(bool closeAll)
+{
+	std::map<std::string, OpenSegment>::iterator it = openSegments.begin();
+
+	while (it != openSegments.end())
+	{
+		OpenSegment &open = it->second;
+
+		if (open.fd >= 0 && open.dirty)
+		{
+			fdatasync(open.fd);
+			open.dirty = false;
+			__atomic_add_fetch(&syncs, 1, __ATOMIC_RELAXED);
+		}
+		if (closeAll || open.fd < 0)
+		{
+			closeSegment(open);
+			openSegments.erase(it++);
+		}
+		else
+			++it;
+	}
+}
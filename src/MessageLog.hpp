@@ -0,0 +1,180 @@
+#ifndef MESSAGELOG_HPP
+#define MESSAGELOG_HPP
+
+#include "HistoryStore.hpp"
+#include "config.hpp"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+#include <pthread.h>
+
+struct LogStats
+{
+	size_t	channels;
+	size_t	segments;
+	size_t	mapped;
+	size_t	mapCap;		// logMaxMappedSegments
+	size_t	records;
+	size_t	dropped;	// Queue full, never reached the disk
+	size_t	syncs;
+	size_t	errors;
+};
+
+// Persistent channel history, one append-only log per channel creation:
+//   <dir>/<hex of folded channel name>-<generation>/<first msgid, 20 digits>.seg
+// The generation is the msgid of the first record the channel logged, so
+// a channel that empties and is created again starts a fresh log and
+// never serves the previous conversation. At startup only the newest
+// generation of each name is recovered (the channel is continuing across
+// the restart); older generations stay on disk, unread.
+// A segment holds logSegmentRecords fixed-size frames, so frame n lives
+// at offset n * logRecordBytes and any record can be read without
+// scanning. Each segment keeps a sparse in-memory index (one entry per
+// logIndexStride frames) of msgid and timestamp; a BEFORE/AFTER lookup
+// binary searches the segments, then the index, and reads at most one
+// stride of frames through a read-only mapping of the segment. At most
+// logMaxMappedSegments segments stay mapped; mapping one more unmaps the
+// least recently read.
+//
+// The event loop only encodes frames into a single-producer ring; a
+// writer thread pwrite()s them and fdatasync()s dirty segments every
+// logSyncMillis (group commit). When the ring is full the frame is
+// dropped and counted, the loop never waits on the disk. An idle writer
+// sleeps until a frame arrives or the next group commit is due. It keeps
+// at most logMaxOpenSegments fds; opening one more first syncs and closes
+// the least recently written.
+class MessageLog
+{
+	private:
+		static const size_t	queueSize = 1024;	// Power of two
+		static const size_t	dirSize = 2 * serverConfig::channelNameLen + 22;
+
+		struct IndexEntry
+		{
+			unsigned long	id;
+			unsigned long	time;
+			size_t			slot;
+		};
+
+		struct Segment
+		{
+			unsigned long			firstId;	// File name
+			size_t					count;		// Frames assigned
+			bool					sealed;		// Recovered: no more appends
+			std::vector<IndexEntry>	index;
+			const unsigned char		*map;		// NULL until read, or unmapped
+			unsigned long			used;		// Read clock, for LRU unmapping
+		};
+
+		struct ChannelLog
+		{
+			std::string				dir;
+			std::vector<Segment>	segments;
+		};
+
+		// A frame on its way to the writer thread
+		struct Pending
+		{
+			char			dir[dirSize];
+			unsigned long	segment;
+			size_t			slot;
+			unsigned char	frame[serverConfig::logRecordBytes];
+		};
+
+		// Writer thread only
+		struct OpenSegment
+		{
+			unsigned long	segment;
+			int				fd;
+			bool			dirty;
+			unsigned long	used;		// Write clock, for LRU eviction
+		};
+
+		typedef std::map<std::string, ChannelLog*>	LogMap;	// By folded name
+
+		struct Position
+		{
+			size_t	segment;
+			size_t	slot;
+		};
+
+		std::string		path;
+		LogMap			logs;
+		size_t			records;
+		mutable size_t			mappedCount;
+		mutable unsigned long	readClock;
+
+		Pending			*queue;
+		size_t			head;		// Next slot written by the loop
+		size_t			tail;		// Next slot read by the writer thread
+		size_t			dropped;
+		size_t			syncs;
+		size_t			errors;
+		bool			running;
+		pthread_t		writer;
+		pthread_mutex_t	wakeLock;
+		pthread_cond_t	wakeup;		// Queue went from empty to non-empty
+
+		std::map<std::string, OpenSegment>	openSegments;	// Writer thread only
+		size_t								openCount;		// fds held in openSegments
+		unsigned long						writeClock;
+
+		MessageLog(); // Block default constructor
+		MessageLog(const MessageLog &other); // Block copy
+		MessageLog&	operator=(const MessageLog &other);
+
+		// Reads (event loop)
+		ChannelLog*	findLog(const std::string &channel) const;
+		bool		mapSegment(const ChannelLog &log, Segment &seg) const;
+		void		unmapSegment(Segment &seg) const;
+		void		evictMapping(const Segment &keep) const;
+		bool		readKey(const ChannelLog &log, Segment &seg, size_t slot,
+						bool byTime, unsigned long &key) const;
+		bool		readRecord(const ChannelLog &log, Segment &seg, size_t slot,
+						HistoryStore::Record &out) const;
+		Position	locate(ChannelLog &log, const HistoryStore::Anchor &anchor,
+						bool inclusive) const;
+		void		recover(const std::string &dir, const std::string &key,
+						unsigned long &maxId);
+
+		// Writer thread
+		static void*	writerMain(void *arg);
+		void			wake();
+		void			waitForFrames(unsigned long deadline);
+		bool			drain();
+		void			writeFrame(const Pending &item);
+		void			closeSegment(OpenSegment &open);
+		void			evictSegment();
+		void			syncAll(bool closeAll);
+
+		std::string		segmentPath(const std::string &dir, unsigned long segment) const;
+
+	public:
+		// Constructor
+		explicit MessageLog(const std::string &path);
+
+		// Destructor
+		~MessageLog();
+
+		// Getter
+		LogStats	getStats() const;
+
+		// Lifecycle: open() recovers existing segments (blocking, before
+		// the loop starts) and returns the highest msgid found
+		unsigned long	open();
+		void			close();
+
+		// Queries fill out in chronological order, at most limit records
+		void	before(const std::string &channel, const HistoryStore::Anchor &anchor,
+					size_t limit, std::vector<HistoryStore::Record> &out) const;
+		void	after(const std::string &channel, const HistoryStore::Anchor &anchor,
+					size_t limit, std::vector<HistoryStore::Record> &out) const;
+
+		// Utilities
+		void	append(const std::string &channel, const HistoryStore::Record &record);
+		void	retire(const std::string &channel);	// Channel destroyed
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "MonitorIndex.hpp"
+#include "Client.hpp"
+#include "CaseMap.hpp"
+
+#include <algorithm>
+
+// Constructor
+MonitorIndex::MonitorIndex() : watches(0) {}
+
+// Getter
+size_t	MonitorIndex::size() const
+{
+	return (watchers.size());
+}
+
+size_t	MonitorIndex::getWatchCount() const
+{
+	return (watches);
+}
+
+const std::vector<Client*>*	MonitorIndex::find(const std::string &nick) const
+{
+	Map::const_iterator it = watchers.find(CaseMap::fold(nick));
+
+	if (it == watchers.end())
+		return (NULL);
+	return (&it->second);
+}
+
+// Utilities
+bool	MonitorIndex::add(Client *client, const std::string &nick)
+{
+	if (!client->addMonitored(nick))
+		return (false);
+	watchers[CaseMap::fold(nick)].push_back(client);
+	++watches;
+	return (true);
+}
+
+bool	MonitorIndex::remove(Client *client, const std::string &nick)
+{
+	if (!client->removeMonitored(nick))
+		return (false);
+
+	Map::iterator it = watchers.find(CaseMap::fold(nick));
+
+	if (it == watchers.end())
+		return (true);
+
+	std::vector<Client*>			&list = it->second;
+	std::vector<Client*>::iterator	pos = std::find(list.begin(), list.end(), client);
+
+	if (pos != list.end())
+	{
+		*pos = list.back();
+		list.pop_back();
+		--watches;
+	}
+	if (list.empty())
+		watchers.erase(it);
+	return (true);
+}
+
+void	MonitorIndex::removeAll(Client *client)
+{
+	while (!client->getMonitored().empty())
+		remove(client, client->getMonitored().back());
+}
+
+void	MonitorIndex::clear()
+{
+	watchers.clear();
+	watches = 0;
+}
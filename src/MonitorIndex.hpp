@@ -0,0 +1,41 @@
+#ifndef MONITORINDEX_HPP
+#define MONITORINDEX_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+
+class Client;
+
+// Reverse index for MONITOR: casefolded nick -> clients watching it.
+// The forward side (what one client watches) lives in the Client, so
+// a presence change touches only the nick's watchers and a disconnect
+// only the departing client's own targets.
+class MonitorIndex
+{
+	private:
+		typedef std::map<std::string, std::vector<Client*> >	Map;
+
+		Map		watchers;
+		size_t	watches;	// Sum of all watcher lists
+
+	public:
+		// Constructor
+		MonitorIndex();
+
+		// Getter
+		size_t	size() const;
+		size_t	getWatchCount() const;
+
+		// Clients watching nick, NULL if none
+		const std::vector<Client*>*	find(const std::string &nick) const;
+
+		// Utilities
+		bool	add(Client *client, const std::string &nick);
+		bool	remove(Client *client, const std::string &nick);
+		void	removeAll(Client *client);
+		void	clear();
+};
+
+#endif
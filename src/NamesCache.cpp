@@ -0,0 +1,109 @@
+#include "NamesCache.hpp"
+
+// Constructor
+NamesCache::NamesCache(size_t budget) : budget(budget), valid(false) {}
+
+// Getter
+bool	NamesCache::isValid() const
+{
+	return (valid);
+}
+
+const std::vector<std::string>&	NamesCache::getChunks() const
+{
+	return (chunks);
+}
+
+// Utilities
+void	NamesCache::invalidate()
+{
+	if (!valid)
+		return ;
+	valid = false;
+	std::vector<std::string>().swap(chunks);
+}
+
+void	NamesCache::reset()
+{
+	chunks.clear();
+	valid = true;
+}
+
+void	NamesCache::append(const std::string &entry)
+{
+	if (!valid)
+		return ;
+
+	if (chunks.empty() || chunks.back().size() + 1 + entry.size() > budget)
+	{
+		chunks.push_back(std::string());
+		chunks.back().reserve(budget);
+	}
+	else
+		chunks.back() += ' ';
+	chunks.back() += entry;
+}
+
+void	NamesCache::remove(const std::string &entry)
+{
+	size_t	chunk;
+	size_t	pos;
+
+	if (!valid)
+		return ;
+	if (!locate(entry, chunk, pos))
+	{
+		invalidate();
+		return ;
+	}
+
+	std::string &text = chunks[chunk];
+
+	// Take the separator on one side along with the entry
+	if (pos + entry.size() < text.size())
+		text.erase(pos, entry.size() + 1);
+	else if (pos > 0)
+		text.erase(pos - 1, entry.size() + 1);
+	else
+		text.clear();
+
+	if (text.empty())
+		chunks.erase(chunks.begin() + chunk);
+}
+
+void	NamesCache::replace(const std::string &oldEntry, const std::string &newEntry)
+{
+	size_t	chunk;
+	size_t	pos;
+
+	if (!valid)
+		return ;
+	if (!locate(oldEntry, chunk, pos)
+		|| chunks[chunk].size() - oldEntry.size() + newEntry.size() > budget)
+	{
+		invalidate();
+		return ;
+	}
+	chunks[chunk].replace(pos, oldEntry.size(), newEntry);
+}
+
+// Finds entry as a whole space delimited word
+bool	NamesCache::locate(const std::string &entry, size_t &chunk, size_t &pos) const
+{
+	for (chunk = 0; chunk < chunks.size(); ++chunk)
+	{
+		const std::string &text = chunks[chunk];
+
+		pos = 0;
+		while ((pos = text.find(entry, pos)) != std::string::npos)
+		{
+			size_t end = pos + entry.size();
+
+			if ((pos == 0 || text[pos - 1] == ' ')
+				&& (end == text.size() || text[end] == ' '))
+				return (true);
+			pos = end;
+		}
+	}
+	return (false);
+}
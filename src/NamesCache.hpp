@@ -0,0 +1,41 @@
+#ifndef NAMESCACHE_HPP
+#define NAMESCACHE_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Pre-chunked nick list of a channel, as sent in RPL_NAMREPLY (353).
+// Each chunk holds space separated "[@]nick" entries and is sized so that
+// ":server 353 <nick> = <channel> :<chunk>\r\n" fits in 512 bytes for the
+// longest allowed nick. Joins append, parts remove and op changes rewrite
+// a single entry in place; only when an edit cannot be done locally is
+// the cache marked stale and rebuilt on the next NAMES.
+class NamesCache
+{
+	private:
+		std::vector<std::string>	chunks;
+		size_t						budget;	// Max bytes per chunk
+		bool						valid;
+
+		NamesCache(); // Block default constructor
+
+		bool	locate(const std::string &entry, size_t &chunk, size_t &pos) const;
+
+	public:
+		// Constructor
+		explicit NamesCache(size_t budget);
+
+		// Getter
+		bool								isValid() const;
+		const std::vector<std::string>&		getChunks() const;
+
+		// Utilities
+		void	invalidate();
+		void	reset();	// Empty and valid, ready to be refilled
+		void	append(const std::string &entry);
+		void	remove(const std::string &entry);
+		void	replace(const std::string &oldEntry, const std::string &newEntry);
+};
+
+#endif
@@ -0,0 +1,39 @@
+#include "NickIndex.hpp"
+#include "CaseMap.hpp"
+
+// Getter
+size_t	NickIndex::size() const
+{
+	return (entries.size());
+}
+
+NickIndex::const_iterator	NickIndex::end() const
+{
+	return (entries.end());
+}
+
+NickIndex::const_iterator	NickIndex::lowerBound(const std::string &foldedPrefix) const
+{
+	return (entries.lower_bound(foldedPrefix));
+}
+
+bool	NickIndex::inRange(const_iterator it, const std::string &foldedPrefix)
+{
+	return (it->first.compare(0, foldedPrefix.size(), foldedPrefix) == 0);
+}
+
+// Utilities
+void	NickIndex::insert(const std::string &nick, Client *client)
+{
+	entries[CaseMap::fold(nick)] = client;
+}
+
+void	NickIndex::erase(const std::string &nick)
+{
+	entries.erase(CaseMap::fold(nick));
+}
+
+void	NickIndex::clear()
+{
+	entries.clear();
+}
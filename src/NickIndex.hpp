@@ -0,0 +1,38 @@
+#ifndef NICKINDEX_HPP
+#define NICKINDEX_HPP
+
+#include <string>
+#include <map>
+#include <cstddef>
+
+class Client;
+
+// Casefolded nicks in sorted order, for WHO/WHOIS masks. A mask's literal
+// prefix ("ab" in "ab*") selects a contiguous range, so a query only walks
+// the entries that can match. Keys are plain folded strings, so a query
+// looks its prefix up without interning it.
+class NickIndex
+{
+	private:
+		typedef std::map<std::string, Client*>	Map;
+
+		Map		entries;
+
+	public:
+		typedef Map::const_iterator	const_iterator;
+
+		// Getter
+		size_t			size() const;
+		const_iterator	end() const;
+
+		// First entry not below foldedPrefix; walk while inRange() holds
+		const_iterator	lowerBound(const std::string &foldedPrefix) const;
+		static bool		inRange(const_iterator it, const std::string &foldedPrefix);
+
+		// Utilities
+		void	insert(const std::string &nick, Client *client);
+		void	erase(const std::string &nick);
+		void	clear();
+};
+
+#endif
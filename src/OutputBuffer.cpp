@@ -0,0 +1,118 @@
+#include "OutputBuffer.hpp"
+
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+static const size_t	maxIovecs = 16;
+
+// Constructor
+OutputBuffer::OutputBuffer() : head(NULL), tail(NULL), length(0) {}
+
+// Destructor
+OutputBuffer::~OutputBuffer()
+{
+	clear();
+}
+
+// Getter
+bool	OutputBuffer::empty() const
+{
+	return (this->length == 0);
+}
+
+size_t	OutputBuffer::size() const
+{
+	return (this->length);
+}
+
+// Utilities
+void	OutputBuffer::append(const char *data, size_t len)
+{
+	length += len;
+	while (len > 0)
+	{
+		if (!tail || tail->end == BufferSegment::capacity)
+		{
+			BufferSegment *segment = BufferPool::acquire();
+
+			if (tail)
+				tail->next = segment;
+			else
+				head = segment;
+			tail = segment;
+		}
+
+		size_t chunk = BufferSegment::capacity - tail->end;
+		if (chunk > len)
+			chunk = len;
+		std::memcpy(tail->data + tail->end, data, chunk);
+		tail->end += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+}
+
+void	OutputBuffer::append(const std::string &data)
+{
+	append(data.data(), data.size());
+}
+
+void	OutputBuffer::clear()
+{
+	while (head)
+	{
+		BufferSegment *next = head->next;
+
+		BufferPool::release(head);
+		head = next;
+	}
+	tail = NULL;
+	length = 0;
+}
+
+ssize_t	OutputBuffer::writeTo(int fd)
+{
+	struct iovec	iov[maxIovecs];
+	struct msghdr	msg;
+	size_t			count = 0;
+
+	for (BufferSegment *seg = head; seg && count < maxIovecs; seg = seg->next)
+	{
+		iov[count].iov_base = seg->data + seg->start;
+		iov[count].iov_len = seg->end - seg->start;
+		++count;
+	}
+	if (count == 0)
+		return (0);
+
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+
+	ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+	if (sent <= 0)
+		return (sent);
+
+	// Drop what left, returning drained segments to the pool
+	size_t left = static_cast<size_t>(sent);
+	length -= left;
+	while (left > 0)
+	{
+		size_t avail = head->end - head->start;
+
+		if (left < avail)
+		{
+			head->start += left;
+			break ;
+		}
+		left -= avail;
+
+		BufferSegment *next = head->next;
+		BufferPool::release(head);
+		head = next;
+	}
+	if (!head)
+		tail = NULL;
+	return (sent);
+}
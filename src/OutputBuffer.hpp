@@ -0,0 +1,43 @@
+#ifndef OUTPUTBUFFER_HPP
+#define OUTPUTBUFFER_HPP
+
+#include "BufferPool.hpp"
+
+#include <string>
+#include <sys/types.h>
+
+// Pending output of one connection: a chain of pooled segments. Segments
+// are taken from BufferPool as data is queued and handed back as soon as
+// they have been written to the socket, so an idle connection owns none.
+class OutputBuffer
+{
+	private:
+		BufferSegment	*head;
+		BufferSegment	*tail;
+		size_t			length;
+
+		OutputBuffer(const OutputBuffer &other); // Block copy
+		OutputBuffer&	operator=(const OutputBuffer &other);
+
+	public:
+		// Constructor
+		OutputBuffer();
+
+		// Destructor
+		~OutputBuffer();
+
+		// Getter
+		bool	empty() const;
+		size_t	size() const;
+
+		// Utilities
+		void	append(const char *data, size_t len);
+		void	append(const std::string &data);
+		void	clear();
+
+		// Writes as much as possible with one sendmsg() and drops the sent
+		// bytes. Same return value as sendmsg().
+		ssize_t	writeTo(int fd);
+};
+
+#endif
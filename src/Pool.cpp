@@ -0,0 +1,130 @@
+#include "Pool.hpp"
+
+#include <sys/mman.h>
+#include <cstring>
+
+// Keep AddressSanitizer able to flag use-after-free on pooled blocks
+#if defined(__SANITIZE_ADDRESS__)
+# include <sanitizer/asan_interface.h>
+# define POOL_POISON(addr, size)	ASAN_POISON_MEMORY_REGION(addr, size)
+# define POOL_UNPOISON(addr, size)	ASAN_UNPOISON_MEMORY_REGION(addr, size)
+#else
+# define POOL_POISON(addr, size)	((void)(addr), (void)(size))
+# define POOL_UNPOISON(addr, size)	((void)(addr), (void)(size))
+#endif
+
+static const size_t	hugePageSize = 2 * 1024 * 1024;
+static const size_t	blockAlign = 16;
+
+// Constructor
+FixedPool::FixedPool(const char *name, size_t blockSize, size_t slabBytes,
+	bool hugePages) : blockSize(blockSize), slabBytes(slabBytes),
+	hugePages(hugePages), freeList(NULL)
+{
+	if (this->blockSize < sizeof(FreeNode))
+		this->blockSize = sizeof(FreeNode);
+	this->blockSize = (this->blockSize + blockAlign - 1) & ~(blockAlign - 1);
+	if (hugePages)
+		this->slabBytes = hugePageSize;
+	if (this->slabBytes < this->blockSize)
+		this->slabBytes = this->blockSize;
+
+	std::memset(&stats, 0, sizeof(stats));
+	stats.name = name;
+	stats.blockSize = this->blockSize;
+}
+
+// Destructor
+FixedPool::~FixedPool()
+{
+	for (size_t i = 0; i < slabs.size(); ++i)
+	{
+		POOL_UNPOISON(slabs[i], slabSizes[i]);
+		munmap(slabs[i], slabSizes[i]);
+	}
+}
+
+void	FixedPool::addSlab()
+{
+	void	*slab = MAP_FAILED;
+	bool	huge = false;
+
+#ifdef MAP_HUGETLB
+	if (hugePages)
+	{
+		slab = mmap(NULL, slabBytes, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		huge = (slab != MAP_FAILED);
+	}
+#endif
+	// No huge pages reserved (or not requested): regular pages
+	if (slab == MAP_FAILED)
+		slab = mmap(NULL, slabBytes, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (slab == MAP_FAILED)
+		throw std::bad_alloc();
+
+	slabs.push_back(slab);
+	slabSizes.push_back(slabBytes);
+	++stats.slabs;
+	if (huge)
+		++stats.hugeSlabs;
+	stats.bytesReserved += slabBytes;
+
+	// Thread the new blocks onto the free list, first block on top
+	char	*base = static_cast<char*>(slab);
+	size_t	count = slabBytes / blockSize;
+
+	for (size_t i = count; i > 0; --i)
+	{
+		FreeNode *node = reinterpret_cast<FreeNode*>(base + (i - 1) * blockSize);
+
+		node->next = freeList;
+		freeList = node;
+		POOL_POISON(base + (i - 1) * blockSize + sizeof(FreeNode),
+					blockSize - sizeof(FreeNode));
+	}
+}
+
+void*	FixedPool::allocate()
+{
+	if (!freeList)
+		addSlab();
+
+	FreeNode *node = freeList;
+
+	freeList = node->next;
+	POOL_UNPOISON(node, blockSize);
+
+	++stats.live;
+	++stats.allocations;
+	if (stats.live > stats.peak)
+		stats.peak = stats.live;
+	return (node);
+}
+
+void	FixedPool::release(void *block)
+{
+	if (!block)
+		return ;
+
+	FreeNode *node = static_cast<FreeNode*>(block);
+
+	node->next = freeList;
+	freeList = node;
+	POOL_POISON(static_cast<char*>(block) + sizeof(FreeNode),
+				blockSize - sizeof(FreeNode));
+
+	--stats.live;
+	++stats.releases;
+}
+
+size_t	FixedPool::getBlockSize() const
+{
+	return (this->blockSize);
+}
+
+const PoolStats&	FixedPool::getStats() const
+{
+	return (this->stats);
+}
@@ -0,0 +1,123 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+#include <cstddef>
+#include <vector>
+#include <new>
+
+// Allocation counters exported through STATS
+struct PoolStats
+{
+	const char	*name;
+	size_t		blockSize;
+	size_t		slabs;
+	size_t		hugeSlabs;	// Slabs actually backed by huge pages
+	size_t		bytesReserved;
+	size_t		live;
+	size_t		peak;
+	size_t		allocations;
+	size_t		releases;
+};
+
+// Fixed size block allocator. Memory comes from mmap()ed slabs (optionally
+// huge pages) carved into equal blocks; released blocks go to a LIFO free
+// list and are reused before a new slab is mapped. Slabs are only returned
+// to the system when the pool is destroyed, so connection churn recycles
+// the same memory instead of fragmenting the heap.
+class FixedPool
+{
+	private:
+		struct FreeNode
+		{
+			FreeNode	*next;
+		};
+
+		size_t				blockSize;
+		size_t				slabBytes;
+		bool				hugePages;
+		std::vector<void*>	slabs;
+		std::vector<size_t>	slabSizes;
+		FreeNode			*freeList;
+		PoolStats			stats;
+
+		FixedPool(); // Block default constructor
+		FixedPool(const FixedPool &other); // Block copy
+		FixedPool&	operator=(const FixedPool &other);
+
+		void	addSlab();
+
+	public:
+		// Constructor
+		FixedPool(const char *name, size_t blockSize, size_t slabBytes, bool hugePages);
+
+		// Destructor
+		~FixedPool();
+
+		void*	allocate();
+		void	release(void *block);
+
+		size_t				getBlockSize() const;
+		const PoolStats&	getStats() const;
+};
+
+// Typed front end: placement-constructs T inside FixedPool blocks
+template <typename T>
+class ObjectPool
+{
+	private:
+		FixedPool	pool;
+
+		ObjectPool(); // Block default constructor
+
+	public:
+		// Constructor
+		ObjectPool(const char *name, size_t slabBytes, bool hugePages)
+			: pool(name, sizeof(T), slabBytes, hugePages) {}
+
+		template <typename A1>
+		T*	create(const A1 &a1)
+		{
+			void *block = pool.allocate();
+
+			try
+			{
+				return (new (block) T(a1));
+			}
+			catch (...)
+			{
+				pool.release(block);
+				throw ;
+			}
+		}
+
+		template <typename A1, typename A2>
+		T*	create(const A1 &a1, const A2 &a2)
+		{
+			void *block = pool.allocate();
+
+			try
+			{
+				return (new (block) T(a1, a2));
+			}
+			catch (...)
+			{
+				pool.release(block);
+				throw ;
+			}
+		}
+
+		void	destroy(T *object)
+		{
+			if (!object)
+				return ;
+			object->~T();
+			pool.release(object);
+		}
+
+		const PoolStats&	getStats() const
+		{
+			return (pool.getStats());
+		}
+};
+
+#endif
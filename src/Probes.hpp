@@ -0,0 +1,34 @@
+#ifndef PROBES_HPP
+#define PROBES_HPP
+
+// USDT probe points, provider "ircserv". When <sys/sdt.h> is available each
+// probe compiles to a single nop plus an ELF note that bpftrace/perf can
+// attach to; otherwise (or with -DIRC_NO_PROBES) they expand to nothing.
+// See tools/bpftrace/ for ready made histograms.
+
+#if !defined(IRC_NO_PROBES) && defined(__has_include)
+# if __has_include(<sys/sdt.h>)
+#  include <sys/sdt.h>
+#  define IRC_HAVE_PROBES 1
+# endif
+#endif
+
+#ifdef IRC_HAVE_PROBES
+# define PROBE_ACCEPT(fd)				DTRACE_PROBE1(ircserv, accept, fd)
+# define PROBE_RECV(fd, bytes)			DTRACE_PROBE2(ircserv, recv, fd, bytes)
+# define PROBE_COMMAND(fd, cmd, len)	DTRACE_PROBE3(ircserv, command, fd, cmd, len)
+# define PROBE_ENQUEUE(fd, bytes)		DTRACE_PROBE2(ircserv, enqueue, fd, bytes)
+# define PROBE_FLUSH(fd, bytes, left)	DTRACE_PROBE3(ircserv, flush, fd, bytes, left)
+# define PROBE_DISCONNECT(fd)			DTRACE_PROBE1(ircserv, disconnect, fd)
+# define PROBE_FANOUT(chan, members)	DTRACE_PROBE2(ircserv, fanout, chan, members)
+#else
+# define PROBE_ACCEPT(fd)				((void)0)
+# define PROBE_RECV(fd, bytes)			((void)0)
+# define PROBE_COMMAND(fd, cmd, len)	((void)0)
+# define PROBE_ENQUEUE(fd, bytes)		((void)0)
+# define PROBE_FLUSH(fd, bytes, left)	((void)0)
+# define PROBE_DISCONNECT(fd)			((void)0)
+# define PROBE_FANOUT(chan, members)	((void)0)
+#endif
+
+#endif
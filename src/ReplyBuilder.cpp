@@ -0,0 +1,93 @@
+#include "ReplyBuilder.hpp"
+#include "Probes.hpp"
+
+// Constructor
+ReplyBuilder::ReplyBuilder(OutputBuffer &out, int fd) : out(out),
+	start(out.size()), fd(fd) {}
+
+// Destructor
+ReplyBuilder::~ReplyBuilder()
+{
+	if (fd != -1)
+		PROBE_ENQUEUE(fd, out.size() - start);
+}
+
+// Fragments
+ReplyBuilder&	ReplyBuilder::operator<<(const std::string &text)
+{
+	out.append(text);
+	return (*this);
+}
+
+ReplyBuilder&	ReplyBuilder::operator<<(const StringRef &text)
+{
+	out.append(text.data(), text.size());
+	return (*this);
+}
+
+ReplyBuilder&	ReplyBuilder::operator<<(char c)
+{
+	out.append(&c, 1);
+	return (*this);
+}
+
+ReplyBuilder&	ReplyBuilder::operator<<(int value)
+{
+	return (*this << static_cast<long>(value));
+}
+
+ReplyBuilder&	ReplyBuilder::operator<<(long value)
+{
+	// Digits are produced back to front into a stack buffer, then copied once
+	char			digits[24];
+	char			*end = digits + sizeof(digits);
+	char			*p = end;
+	unsigned long	mag = value < 0 ? 0UL - static_cast<unsigned long>(value)
+									: static_cast<unsigned long>(value);
+
+	do
+	{
+		*--p = static_cast<char>('0' + mag % 10);
+		mag /= 10;
+	} while (mag);
+
+	if (value < 0)
+		*--p = '-';
+
+	out.append(p, end - p);
+	return (*this);
+}
+
+ReplyBuilder&	ReplyBuilder::operator<<(size_t value)
+{
+	char	digits[24];
+	char	*end = digits + sizeof(digits);
+	char	*p = end;
+
+	do
+	{
+		*--p = static_cast<char>('0' + value % 10);
+		value /= 10;
+	} while (value);
+
+	out.append(p, end - p);
+	return (*this);
+}
+
+ReplyBuilder&	ReplyBuilder::numeric(int code)
+{
+	char	digits[3];
+
+	digits[0] = static_cast<char>('0' + (code / 100) % 10);
+	digits[1] = static_cast<char>('0' + (code / 10) % 10);
+	digits[2] = static_cast<char>('0' + code % 10);
+
+	out.append(digits, 3);
+	return (*this);
+}
+
+ReplyBuilder&	ReplyBuilder::append(const char *data, size_t len)
+{
+	out.append(data, len);
+	return (*this);
+}
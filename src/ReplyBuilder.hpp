@@ -0,0 +1,50 @@
+#ifndef REPLYBUILDER_HPP
+#define REPLYBUILDER_HPP
+
+#include "OutputBuffer.hpp"
+#include "StringRef.hpp"
+
+#include <string>
+#include <cstddef>
+
+// Appends the pieces of an IRC line straight into a destination output
+// buffer. String literals are copied with their compile-time length, so
+// fragments like ":" SERVER_NAME " 366 " never go through strlen() or a
+// temporary std::string. When bound to a client fd, the bytes appended
+// over the builder's lifetime are reported to the enqueue probe.
+class ReplyBuilder
+{
+	private:
+		OutputBuffer	&out;
+		size_t			start;
+		int			fd;
+
+		ReplyBuilder(); // Block default constructor
+
+	public:
+		// Constructor
+		explicit ReplyBuilder(OutputBuffer &out, int fd = -1);
+
+		// Destructor
+		~ReplyBuilder();
+
+		// Fragments
+		template <size_t N>
+		ReplyBuilder&	operator<<(const char (&fragment)[N])
+		{
+			out.append(fragment, N - 1);
+			return (*this);
+		}
+		ReplyBuilder&	operator<<(const std::string &text);
+		ReplyBuilder&	operator<<(const StringRef &text);
+		ReplyBuilder&	operator<<(char c);
+		ReplyBuilder&	operator<<(int value);
+		ReplyBuilder&	operator<<(long value);
+		ReplyBuilder&	operator<<(size_t value);
+
+		// Three digit, zero padded numeric ("001", "366")
+		ReplyBuilder&	numeric(int code);
+		ReplyBuilder&	append(const char *data, size_t len);
+};
+
+#endif
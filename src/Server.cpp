@@ -4,22 +4,50 @@
 #include "ClientMessageHandler.hpp"
 #include "IRCReplies.hpp"
 #include "config.hpp"
+#include "Utils.hpp"
 #include "Bot.hpp"
+#include "ReplyBuilder.hpp"
+#include "Logger.hpp"
+#include "Probes.hpp"
+#include "CaseMap.hpp"
+#include "BufferPool.hpp"
 
-#include <iostream>
-#include <sstream>
+#include <algorithm>
 #include <cstring>
+#include <stdexcept>
 #include <ctime>
 #include <arpa/inet.h>
 #include <errno.h>
 #include <unistd.h>
+#include <csignal>
+
+volatile sig_atomic_t	Server::stopSignal = 0;
+volatile sig_atomic_t	Server::reloadSignal = 0;
 
 //Constructor
-Server::Server(int port, const std::string &password) : port(port), password(password)
+Server::Server(int port, const std::string &password) : port(port), password(password),
+	clientCount(0),
+	peerEpoch(0),
+	clientPool("client", serverConfig::slabBytes, serverConfig::hugePages),
+	channelPool("channel", serverConfig::slabBytes, serverConfig::hugePages),
+	commandArena(serverConfig::arenaBytes),
+	contentFilter(serverConfig::filterFile),
+	history(serverConfig::historyPerChannel, serverConfig::historyBudget),
+	messageLog(serverConfig::logDir),
+	readBuffer(BUFFER_SIZE),
+	bot(NULL)
 {
+	std::time_t	now = std::time(NULL);
+	char		created[32];
+
+	std::strftime(created, sizeof(created), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+	createdAt = created;
+
 	// Create the server socket
 	// int socket(int domain, int type, int protocol);
 	// return: socket_fd OK / -1 ERROR
+	CaseMap::configure(serverConfig::caseMapping);
+
 	listenFd = socket(serverConfig::domain, serverConfig::type, serverConfig::protocol);
 
 	if (listenFd == -1)
@@ -79,50 +107,251 @@ Server::Server(int port, const std::string &password) : port(port), password(pas
 Server::~Server()
 {
 	close(listenFd);
+	messageLog.close();
 
-	for (std::map<int, Client*>::iterator it = clientsByFd.begin();
-		it != clientsByFd.end(); ++it)
+	for (size_t fd = 0; fd < clientsByFd.size(); ++fd)
 	{
-    	delete it->second;
+    	clientPool.destroy(clientsByFd[fd]);
 	}
 	
 	clientsByFd.clear();
 	clientsByNick.clear();
+	nickIndex.clear();
+	monitors.clear();
+	history.clear();
 
-	for (std::map<std::string, Channel*>::iterator it = channels.begin();
-		it != channels.end(); ++it)
+	for (size_t i = 0; i < channels.capacity(); ++i)
 	{
-    	delete it->second;
+    	channelPool.destroy(channels.slotValue(i));
 	}
 	
 	channels.clear();
+
+	delete bot;
 }
 
 void	Server::addChannel(const std::string &name, const std::string &topic)
 {
-	if (channels.find(name) == channels.end())
+	if (!channels.find(name))
 	{
-		Channel *newChannel = new Channel(name, topic);
-		channels[name] = newChannel;
+		Channel *newChannel = channelPool.create(name, topic);
+		channels.insert(name, newChannel);
+		newChannel->setSizeIndex(&channelsBySize);
 	}
 	else
 		throw std::runtime_error("Channel already exists.");
 }
 
+// New channel for a first JOIN. NULL when the server wide cap is reached.
+Channel*	Server::createChannel(const std::string &name)
+{
+	if (channels.size() >= serverConfig::maxChannels || channels.find(name))
+		return (NULL);
+
+	Channel *channel = channelPool.create(name, std::string());
+
+	channels.insert(name, channel);
+	channel->setSizeIndex(&channelsBySize);
+	return (channel);
+}
+
+// Destroys a channel once its last member has left. Pending invites are
+// dropped from the invited clients' lists first, so nothing keeps a
+// pointer into the freed block.
+void	Server::reclaimChannel(Channel *channel)
+{
+	if (!channel || channel->getMemberCount() > 0)
+		return ;
+
+	const std::vector<unsigned int> &invited = channel->getInvited();
+	while (!invited.empty())
+	{
+		Client *client = getClientById(invited.back());
+
+		if (client)
+			channel->removeInvited(client);
+		else
+			channel->dropInvited(invited.back());
+	}
+
+	history.drop(channel);
+	messageLog.retire(channel->getName());
+	channels.erase(channel->getName());
+	channelPool.destroy(channel);
+}
+
 // Getter
 const std::string&	Server::getPassword() const
 {
 	return (this->password);
 }
 
-const std::map<std::string, Client*>&	Server::getClientsByNick() const
+// Registered clients only: a nick reserved by a connection that has not
+// finished registering is not addressable yet.
+Client*	Server::findClient(const StringRef &nick) const
 {
-	return (this->clientsByNick);
+	Client *client = clientsByNick.find(nick);
+
+	if (!client || !client->isAuthenticated())
+		return (NULL);
+	return (client);
 }
 
-const std::map<std::string, Channel*>&	Server::getChannels() const
+Channel*	Server::findChannel(const StringRef &name) const
 {
-	return (this->channels);
+	return (channels.find(name));
+}
+
+// Reserves nick for client (registered or not). Fails if another
+// connection holds a nick that casefolds to the same key.
+bool	Server::claimNickname(Client *client, const std::string &nick)
+{
+	Client *holder = clientsByNick.find(nick);
+
+	if (holder && holder != client)
+		return (false);
+
+	if (!client->getNickname().empty())
+	{
+		clientsByNick.erase(client->getNickname());
+		nickIndex.erase(client->getNickname());
+	}
+	clientsByNick.insert(nick, client);
+	nickIndex.insert(nick, client);
+	client->setNickname(nick);
+	return (true);
+}
+
+// Rename of a registered client: rekeys the nick registry and the names
+// entries of the client's own channels, then tells the client and each
+// peer exactly once. Nothing here depends on the total channel count.
+bool	Server::changeNickname(Client *client, const std::string &nick)
+{
+	if (nick == client->getNickname())
+		return (true);
+
+	ArenaString	wire(commandArena);
+	std::string	oldNick = client->getNickname();
+
+	wire << client->getPrefix() << " NICK :" << nick << "\r\n";
+	if (!claimNickname(client, nick))
+		return (false);
+
+	const std::vector<Channel*> &joined = client->getChannels();
+
+	for (size_t i = 0; i < joined.size(); ++i)
+		joined[i]->renameMember(client, oldNick);
+
+	deliver(client, wire.ref());
+	broadcastToPeers(client, wire.ref());
+
+	// A case-only rename keeps the same folded key: watchers see no change
+	if (!CaseMap::equals(oldNick, nick))
+	{
+		notifyMonitors(oldNick, NULL);
+		notifyMonitors(nick, client);
+	}
+	return (true);
+}
+
+Client*	Server::getClientByFd(int fd) const
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= clientsByFd.size())
+		return (NULL);
+	return (clientsByFd[fd]);
+}
+
+Client*	Server::getClientById(unsigned int id) const
+{
+	if (id >= clientsById.size())
+		return (NULL);
+	return (clientsById[id]);
+}
+
+// Pooled allocation
+Client*	Server::createClient(int fd)
+{
+	return (clientPool.create(fd));
+}
+
+void	Server::destroyClient(Client *client)
+{
+	clientPool.destroy(client);
+}
+
+Arena&	Server::getCommandArena()
+{
+	return (commandArena);
+}
+
+ContentFilter&	Server::getContentFilter()
+{
+	return (contentFilter);
+}
+
+HistoryStore&	Server::getHistory()
+{
+	return (history);
+}
+
+MessageLog&	Server::getMessageLog()
+{
+	return (messageLog);
+}
+
+// Stamps the event once and hands the same record to the in-memory ring
+// and to the disk log's writer queue
+void	Server::recordHistory(const Channel *channel, HistoryStore::Kind kind,
+			const IString &source, const IString &text)
+{
+	HistoryStore::Record record = history.stamp(kind, source, text);
+
+	history.append(channel, record);
+	messageLog.append(channel->getName(), record);
+}
+
+const NickIndex&	Server::getNickIndex() const
+{
+	return (nickIndex);
+}
+
+MonitorIndex&	Server::getMonitors()
+{
+	return (monitors);
+}
+
+// Client ids are dense: released ids are handed out again first
+void	Server::assignClientId(Client *client)
+{
+	if (client->getId() != Client::noId)
+		return ;
+
+	unsigned int id;
+
+	if (!freeIds.empty())
+	{
+		id = freeIds.back();
+		freeIds.pop_back();
+	}
+	else
+	{
+		id = static_cast<unsigned int>(clientsById.size());
+		clientsById.push_back(NULL);
+		peerStamp.push_back(0);
+	}
+	clientsById[id] = client;
+	client->setId(id);
+}
+
+void	Server::releaseClientId(Client *client)
+{
+	unsigned int id = client->getId();
+
+	if (id == Client::noId || id >= clientsById.size())
+		return ;
+	clientsById[id] = NULL;
+	freeIds.push_back(id);
+	client->setId(Client::noId);
 }
 
 // Execution flow
@@ -138,19 +367,42 @@ void	Server::run()
 	b->join("#welcome");
 
 	addPollFd(listenFd);
+	contentFilter.reload();
+
+	// msgids continue after whatever the disk log already holds
+	history.setNextId(messageLog.open() + 1);
 
-	while (true)
+	while (!stopSignal)
 	{
+		if (reloadSignal)
+		{
+			reloadSignal = 0;
+			contentFilter.reload();
+		}
+
 		if (poll(&pollFds[0], pollFds.size(), serverConfig::pollTimeout) < 0)	
+		{
+			if (errno == EINTR)
+				continue ;
             throw std::runtime_error("poll() failed");
+		}
+
+		Logger::tick();
 		
-		size_t n = pollFds.size();
-		for (size_t i = 0; i < n; ++i)
+		// A disconnect swaps the last pollfd into the current slot, so the
+		// index only advances when the slot still holds the same fd.
+		size_t i = 0;
+		while (i < pollFds.size())
 		{
+			int		fd = pollFds[i].fd;
+			short	revents = pollFds[i].revents;
+
+			pollFds[i].revents = 0;
+
 			// READ (POLLIN)
-			if (pollFds[i].revents & POLLIN)
+			if (revents & (POLLIN | POLLHUP | POLLERR))
 			{
-				if (pollFds[i].fd == listenFd)	// Server poll
+				if (fd == listenFd)	// Server poll
 				{
 					try
 					{
@@ -158,35 +410,47 @@ void	Server::run()
 					}
 					catch (const std::exception &e)
 					{
-						std::cerr << "Error: " << e.what() << std::endl;
+						LOG_ERROR(std::string(e.what()));
 					}		
 				}
 				else // Client poll
 				{
 					try
 					{
-						handleClientMessage(pollFds[i].fd);
+						handleClientMessage(fd);
 					}
 					catch (const ClientDisconnectedException &e) {}
 				}
 			}
 
+			if (i >= pollFds.size() || pollFds[i].fd != fd)
+				continue ;
+
 			// WRITE (POLLOUT)
-			if (pollFds[i].revents & POLLOUT)
+			if (revents & POLLOUT)
 			{
-				Client* client = clientsByFd[pollFds[i].fd];
-				if (!client->getBufferOut().empty())
+				Client *client = getClientByFd(fd);
+				if (client)
 				{
-					sendPendingMessages(client);
-					if (client->getBufferOut().empty())
+					try
+					{
+						sendPendingMessages(client);
+						if (client->getBufferOut().empty())
+							pollFds[i].events &= ~POLLOUT;
+					}
+					catch (const ClientDisconnectedException &e)
 					{
-                        pollFds[i].events &= ~POLLOUT;
+						continue ;
 					}
 				}
 			}
 
-			pollFds[i].revents = 0;
+			++i;
 		}
+
+		// Replies produced during this tick leave in one send() per client
+		continueListings();
+		flushPendingClients();
 	}
 }
 
@@ -213,40 +477,57 @@ void	Server::acceptNewClient()
 		int flags = fcntl(clientFd, F_GETFL, 0);
 		fcntl(clientFd, F_SETFL, flags | O_NONBLOCK);
 
-		logMessage("New client accepted");
-		Client *newClient = new Client(clientFd);
+		PROBE_ACCEPT(clientFd);
+		Client *newClient = createClient(clientFd);
+		if (static_cast<size_t>(clientFd) >= clientsByFd.size())
+			clientsByFd.resize(clientFd + 1, NULL);
 		clientsByFd[clientFd] = newClient;
-		std::ostringstream oss;
-		oss << "Total clients: " << clientsByFd.size();
-		logMessage(oss.str());
+		++clientCount;
+		assignClientId(newClient);
+		LOG_INFO("New client accepted, total clients: "
+			+ Utils::toString(static_cast<int>(clientCount)));
 
 		addPollFd(clientFd);
 	}
 }
 
+// Reads land in the shared scratch buffer unless the client is holding a
+// partial line, in which case they go straight after it in its segment.
+// Whatever is left unterminated is stashed in the client's segment.
 void	Server::handleClientMessage(int fd)
 {
-	std::map<int, Client*>::iterator	it;
-	char								buf[BUFFER_SIZE];
-	Client 								*client;
+	Client			*client = getClientByFd(fd);
 
-	it = clientsByFd.find(fd);
-	if (it == clientsByFd.end())
+	if (!client)
 		return ;
-		
-	client = it->second;
 
-	int bytesRead = recv(client->getClientFd(), buf, BUFFER_SIZE - 1, 0);
+	BufferSegment	*pending = client->getInput();
+	char			*dst = pending ? pending->data + pending->end : &readBuffer[0];
+	size_t			room = pending ? BufferSegment::capacity - pending->end
+									: readBuffer.size();
+
+	if (room == 0)
+		disconnectClient(client, "Input line too long");
+
+	ssize_t bytesRead = recv(client->getClientFd(), dst, room, 0);
+
+	PROBE_RECV(fd, bytesRead);
 
 	if (bytesRead > 0)
 	{
-		client->appendToBuffer(std::string(buf, bytesRead));
-		// TODO DEBUG
-    	std::cout << "DEBUG Client[" << fd << "]:"
-			<< std::string(buf, bytesRead) << std::endl;
+		const char	*data = pending ? pending->data + pending->start : dst;
+		size_t		len = pending ? pending->end - pending->start + bytesRead
+								: static_cast<size_t>(bytesRead);
+
+		LOG_DEBUG("Client[" + Utils::toString(fd) + "] buffer: "
+			+ std::string(data, len));
 
-		std::cout << "Client[" << fd << "] buffer: " << client->getBuffer() << std::endl;
-		ClientMessageHandler::handleMessage(*this, *client);
+		size_t consumed = ClientMessageHandler::handleMessage(*this, *client,
+							data, len);
+
+		if (len - consumed > BufferSegment::capacity)
+			disconnectClient(client, "Input line too long");
+		client->stashInput(data + consumed, len - consumed);
 	}
 	else if (bytesRead == 0
 			|| (bytesRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
@@ -257,40 +538,67 @@ void	Server::handleClientMessage(int fd)
 
 void	Server::disconnectClient(Client *client, const std::string& reason)
 {
-	std::ostringstream oss;
-	oss << "Client[" << client->getClientFd() << "] disconnected.";
-	logMessage(oss.str());
+	PROBE_DISCONNECT(client->getClientFd());
+	LOG_INFO("Client[" + Utils::toString(client->getClientFd()) + "] disconnected.");
+
+	// Best effort: queued replies go out together with the ERROR line
+	OutputBuffer &msg = client->getBufferOut();
+	ReplyBuilder(msg) << "ERROR :disconnected: " << reason << "\r\n";
+	msg.writeTo(client->getClientFd());
 
-	std::string msg = "ERROR :disconnected: " + reason + "\r\n";
-	send(client->getClientFd(), msg.c_str(), msg.size(), 0); 
+	int fd = client->getClientFd();
 
-	removePollFd(client->getClientFd());
+	removePollFd(fd);
 	
-	if (client->getClientFd() >= 0)
+	if (fd >= 0)
 	{
-		close(client->getClientFd());
+		close(fd);
 		client->setClientFd(-1);
 	}
 
-    clientsByFd.erase(client->getClientFd());
-    if (!client->getNickname().empty())
+	if (getClientByFd(fd) == client)
+	{
+		clientsByFd[fd] = NULL;
+		--clientCount;
+	}
+    if (!client->getNickname().empty()
+		&& clientsByNick.find(client->getNickname()) == client)
 	{
 		clientsByNick.erase(client->getNickname());
+		nickIndex.erase(client->getNickname());
 	}
 
-	for (std::map<std::string, Channel*>::iterator it = channels.begin();
-		it != channels.end(); ++it)
+	// Peers learn about the departure before the member lists change
+	if (!client->getChannels().empty())
 	{
-		Channel* chan = it->second;
-		if (chan)
-		{
-			chan->removeUser(client->getNickname());
-			chan->removeOperator(client);
-			chan->removeInvited(client);
-		}
+		std::string wire;
+
+		wire.reserve(client->getPrefix().size() + reason.size() + 16);
+		wire += client->getPrefix();
+		wire += " QUIT :";
+		wire += reason;
+		wire += "\r\n";
+		broadcastToPeers(client, StringRef(wire));
 	}
 
-	delete client;
+	// Only the channels this client is in (or invited to) are touched
+	while (!client->getChannels().empty())
+	{
+		Channel *channel = client->getChannels().back();
+
+		channel->removeUser(client);
+		reclaimChannel(channel);
+	}
+	while (!client->getInvites().empty())
+		client->getInvites().back()->removeInvited(client);
+
+	monitors.removeAll(client);
+	if (client->isAuthenticated())
+		notifyMonitors(client->getNickname(), NULL);
+
+	cancelListing(client);
+	releaseClientId(client);
+	destroyClient(client);
 
 	throw ClientDisconnectedException();
 }
@@ -302,19 +610,160 @@ void	Server::authenticateClient(Client *client)
 	{
 		client->setAuthenticated(true);
 
-		clientsByNick[client->getNickname()] = client;
+		OutputBuffer *out = beginReply(client);
+		if (!out)
+			return ;
 
-		sendNumeric(client, RPL_WELCOME, std::string("Welcome to " + serverConfig::serverName
-			+ " " + client->getNickname()));
+		const std::string	&nick = client->getNickname();
+		ReplyBuilder		rb(*out, client->getClientFd());
+
+		// Registration burst (001-004) rendered in a single pass
+		rb << ":" SERVER_NAME " 001 " << nick << " :Welcome to " SERVER_NAME " "
+			<< nick << "\r\n";
+		rb << ":" SERVER_NAME " 002 " << nick << " :Your host is " SERVER_NAME
+			", running version " SERVER_VERSION "\r\n";
+		rb << ":" SERVER_NAME " 003 " << nick << " :This server was created "
+			<< createdAt << "\r\n";
+		rb << ":" SERVER_NAME " 004 " << nick << " " SERVER_NAME " " SERVER_VERSION
+			" i beIiklot\r\n";
+		rb << ":" SERVER_NAME " 005 " << nick << " CASEMAPPING=" << StringRef(CaseMap::getName())
+			<< " CHANTYPES=# PREFIX=(o)@ CHANMODES=beI,k,l,it EXCEPTS INVEX"
+			" NICKLEN=" << serverConfig::nickLen
+			<< " CHANLIMIT=#:" << serverConfig::maxChannelsPerUser
+			<< " TARGMAX=PRIVMSG:" << serverConfig::maxTargets
+			<< ",NOTICE:" << serverConfig::maxTargets
+			<< " CHANNELLEN=" << serverConfig::channelNameLen
+			<< " MODES=" << serverConfig::maxModeParams
+			<< " MAXLIST=beI:" << serverConfig::maxListEntries
+			<< " :are supported by this server\r\n";
+		rb << ":" SERVER_NAME " 005 " << nick << " ELIST=MU"
+			<< " MONITOR=" << serverConfig::maxMonitor
+			<< " CHATHISTORY=" << serverConfig::historyQueryLimit
+			<< " MSGREFTYPES=msgid,timestamp"
+			<< " :are supported by this server\r\n";
+
+		notifyMonitors(nick, client);
 	}
 }
 
+// RPL_MONONLINE (online set) or RPL_MONOFFLINE to each client monitoring
+// nick; costs one reply per watcher, nothing when nobody watches
+void	Server::notifyMonitors(const std::string &nick, const Client *online)
+{
+	const std::vector<Client*> *watchers = monitors.find(nick);
+
+	if (!watchers)
+		return ;
+
+	for (size_t i = 0; i < watchers->size(); ++i)
+	{
+		const Client	*watcher = (*watchers)[i];
+		OutputBuffer	*out = beginReply(watcher);
+
+		if (!out)
+			continue ;
+
+		ReplyBuilder	rb(*out, watcher->getClientFd());
+
+		rb << ":" SERVER_NAME " ";
+		if (online)
+		{
+			const std::string &prefix = online->getPrefix();
+
+			rb.numeric(RPL_MONONLINE) << ' ' << watcher->getNickname() << " :"
+				<< StringRef(prefix.data() + 1, prefix.size() - 1) << "\r\n";
+		}
+		else
+			rb.numeric(RPL_MONOFFLINE) << ' ' << watcher->getNickname() << " :"
+				<< nick << "\r\n";
+	}
+}
+
+static void	appendPoolStats(ReplyBuilder &rb, const std::string &nick,
+				const PoolStats &st)
+{
+	rb << ":" SERVER_NAME " 249 " << nick << " :" << StringRef(st.name)
+		<< " block=" << st.blockSize << " live=" << st.live
+		<< " peak=" << st.peak << " slabs=" << st.slabs
+		<< " huge=" << st.hugeSlabs << " reserved=" << st.bytesReserved
+		<< " allocs=" << st.allocations << " frees=" << st.releases << "\r\n";
+}
+
+// STATS M: per-pool memory usage
+void	Server::sendStats(Client *client, const StringRef &query)
+{
+	OutputBuffer *out = beginReply(client);
+	if (!out)
+		return ;
+
+	const std::string	&nick = client->getNickname();
+	ReplyBuilder		rb(*out, client->getClientFd());
+
+	if (query == "M" || query == "m")
+	{
+		appendPoolStats(rb, nick, clientPool.getStats());
+		appendPoolStats(rb, nick, channelPool.getStats());
+		appendPoolStats(rb, nick, BufferPool::getStats());
+		appendPoolStats(rb, nick, IString::getPoolStats());
+
+		InternStats is = IString::getStats();
+		rb << ":" SERVER_NAME " 249 " << nick << " :strings entries=" << is.entries
+			<< " refs=" << is.references << " stored=" << is.bytesStored
+			<< " logical=" << is.bytesLogical << "\r\n";
+		rb << ":" SERVER_NAME " 249 " << nick << " :mask-sets shared="
+			<< MaskSet::getSharedCount() << "\r\n";
+		rb << ":" SERVER_NAME " 249 " << nick << " :monitor nicks="
+			<< monitors.size() << " watches=" << monitors.getWatchCount() << "\r\n";
+
+		FilterStats fs = contentFilter.getStats();
+		rb << ":" SERVER_NAME " 249 " << nick << " :filter patterns=" << fs.patterns
+			<< " states=" << fs.states << " classes=" << fs.classes
+			<< " table=" << fs.tableBytes << " scanned=" << fs.bytesScanned
+			<< " hits=" << fs.hits << "\r\n";
+
+		HistoryStats hs = history.getStats();
+		rb << ":" SERVER_NAME " 249 " << nick << " :history channels=" << hs.channels
+			<< " records=" << hs.records << " bytes=" << hs.bytes
+			<< " budget=" << hs.budget << " evicted=" << hs.evicted << "\r\n";
+
+		LogStats ls = messageLog.getStats();
+		rb << ":" SERVER_NAME " 249 " << nick << " :log channels=" << ls.channels
+			<< " segments=" << ls.segments << " mapped=" << ls.mapped << "/" << ls.mapCap
+			<< " records=" << ls.records << " dropped=" << ls.dropped
+			<< " syncs=" << ls.syncs << " errors=" << ls.errors << "\r\n";
+		// Idle: no partial line held and nothing queued for output
+		size_t idle = 0;
+		size_t idleBytes = 0;
+
+		for (size_t fd = 0; fd < clientsByFd.size(); ++fd)
+		{
+			Client *c = clientsByFd[fd];
+
+			if (!c || c->getInput() || !c->getBufferOut().empty())
+				continue ;
+			++idle;
+			idleBytes += c->getFootprint() + sizeof(struct pollfd)
+						+ sizeof(int) + 2 * sizeof(Client*);
+		}
+		rb << ":" SERVER_NAME " 249 " << nick << " :connections total="
+			<< clientCount << " idle=" << idle << " bytes-per-idle="
+			<< (idle ? idleBytes / idle : 0) << "\r\n";
+		rb << ":" SERVER_NAME " 249 " << nick << " :command-arena block="
+			<< commandArena.getBlockSize() << " peak="
+			<< commandArena.getHighWater() << "\r\n";
+	}
+	rb << ":" SERVER_NAME " 219 " << nick << " " << query
+		<< " :End of /STATS report\r\n";
+}
+
 // Bot
 
 void Server::registerBotClient(Client* c)
 {
     if (!c || c->getNickname().empty()) return;
-    clientsByNick[c->getNickname()] = c;  // without fd and poll
+    assignClientId(c);
+    clientsByNick.insert(c->getNickname(), c);  // without fd and poll
+    nickIndex.insert(c->getNickname(), c);
 }
 
 void Server::addChannelBot(const std::string& name, const std::string& topic)
@@ -340,144 +789,223 @@ void	Server::addPollFd(int fd)
 
 	newPoll.fd = fd;
 	newPoll.events = serverConfig::pollReadEvent;
+	newPoll.revents = 0;
+	if (static_cast<size_t>(fd) >= pollSlots.size())
+		pollSlots.resize(fd + 1, -1);
+	pollSlots[fd] = static_cast<int>(pollFds.size());
 	pollFds.push_back(newPoll);
 }
 
+// The last pollfd moves into the freed slot
 void	Server::removePollFd(int fd)
 {
-	for (size_t i = 0; i < pollFds.size(); ++i)
-	{
-		if (pollFds[i].fd == fd)
-		{
-			pollFds[i] = pollFds.back();
-			pollFds.pop_back();
-			return ;
-		}
-	}
+	if (fd < 0 || static_cast<size_t>(fd) >= pollSlots.size() || pollSlots[fd] < 0)
+		return ;
+
+	size_t slot = pollSlots[fd];
+
+	pollFds[slot] = pollFds.back();
+	pollSlots[pollFds[slot].fd] = static_cast<int>(slot);
+	pollFds.pop_back();
+	pollSlots[fd] = -1;
 }
 
 // Utilities
-void	Server::sendRaw(const Client *client, const std::string &text)
+
+// Returns the output buffer a reply can be rendered into and schedules the
+// client for the end-of-tick flush. NULL for clients without a socket (bot).
+OutputBuffer*	Server::beginReply(const Client *client)
 {
-	if (!client)
-		return;
+	if (!client || client->getClientFd() == -1)
+		return (NULL);
 
-    int fd = client->getClientFd();
-	// Ignore Bots
-    if (fd == -1)
-		return;
+	Client* targetClient = getClientByFd(client->getClientFd());
 
-	std::map<int, Client*>::iterator it = clientsByFd.find(fd);
-    if (it == clientsByFd.end()) return;
+	if (!targetClient)
+		return (NULL);
 
-    Client* targetClient = it->second;
-	sendToClient(targetClient->getClientFd(), text + "\r\n");
+	if (!targetClient->isFlushQueued())
+	{
+		targetClient->setFlushQueued(true);
+		pendingFlush.push_back(targetClient->getClientFd());
+	}
+
+	return (&targetClient->getBufferOut());
 }
 
-void	Server::sendNotice(const Client *client, const std::string &text)
+// Queues an already terminated wire line
+void	Server::deliver(const Client *client, const StringRef &wire)
 {
-	if (!client)
-		return;
+	OutputBuffer *out = beginReply(client);
 
-    int fd = client->getClientFd();
-	// Ignore Bots
-    if (fd == -1)
-		return;
+	if (out)
+	{
+		out->append(wire.data(), wire.size());
+		PROBE_ENQUEUE(client->getClientFd(), wire.size());
+	}
+}
 
-	std::map<int, Client*>::iterator it = clientsByFd.find(fd);
-    if (it == clientsByFd.end()) return;
+void	Server::sendRaw(const Client *client, const StringRef &text)
+{
+	OutputBuffer *out = beginReply(client);
 
-    Client* targetClient = it->second;
+	if (out)
+		ReplyBuilder(*out, client->getClientFd()) << text << "\r\n";
+}
 
-	std::string	msg;
-	std::string	target = "*";
+// Queues one pre-rendered line for every member of a channel
+void	Server::broadcast(const Channel *channel, const StringRef &wire,
+						const Client *except)
+{
+	const Channel::Member	*members = channel->getMembers().data();
+	size_t					count = channel->getMembers().size();
 
-	if (!targetClient->getNickname().empty())
-		target = targetClient->getNickname();
+	PROBE_FANOUT(channel->getName().c_str(), count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Client *member = getClientById(members[i].id);
 
-	msg = ":" + serverConfig::serverName + " NOTICE " + target
-		+ " :" + text + "\r\n";
+		if (member && member != except)
+			deliver(member, wire);
+	}
+}
+
+// Server NOTICE to each operator of channel
+void	Server::noticeOperators(const Channel *channel, const std::string &text)
+{
+	const Channel::Member	*members = channel->getMembers().data();
+	size_t					count = channel->getMembers().size();
 
-	sendToClient(targetClient->getClientFd(), msg);
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (!(members[i].roles & Channel::ROLE_OPERATOR))
+			continue ;
+		if (const Client *op = getClientById(members[i].id))
+			sendNotice(op, text);
+	}
 }
 
-void	Server::sendPrivMsg(const Client *from, const std::string &target,
-							const Client* to, const std::string &text)
+// Sends wire once to every client sharing at least one channel with
+// client (client excluded). Peers already reached in this event carry the
+// current epoch in peerStamp, so the cost is one pass over the memberships
+// of client's channels, with no per-event allocation.
+void	Server::broadcastToPeers(const Client *client, const StringRef &wire)
 {
-	 // Sanity check
-	if (!to)
-		return;
-    int fd = to->getClientFd();
-	// Bot without fd: send only by clientsByNick
-    if (fd == -1)
-		return;
+	const std::vector<Channel*>	&joined = client->getChannels();
 
-	std::map<int, Client*>::iterator it = clientsByFd.find(fd);
-    if (it == clientsByFd.end()) return;
+	if (++peerEpoch == 0)
+	{
+		std::fill(peerStamp.begin(), peerStamp.end(), 0u);
+		peerEpoch = 1;
+	}
+	if (client->getId() < peerStamp.size())
+		peerStamp[client->getId()] = peerEpoch;
 
-	std::string prefix = ":" + from->getNickname() + "!" + from->getUsername()
-							+ "@" + from->getHostname();
+	for (size_t c = 0; c < joined.size(); ++c)
+	{
+		const Channel::Member	*members = joined[c]->getMembers().data();
+		size_t					count = joined[c]->getMembers().size();
 
-	std::string fullMessage = prefix + " PRIVMSG " + target	+ " :" + text + "\r\n";
+		for (size_t i = 0; i < count; ++i)
+		{
+			unsigned int id = members[i].id;
 
-    sendToClient(to->getClientFd(), fullMessage);
+			if (id >= peerStamp.size() || peerStamp[id] == peerEpoch)
+				continue ;
+			peerStamp[id] = peerEpoch;
+			if (const Client *peer = getClientById(id))
+				deliver(peer, wire);
+		}
+	}
 }
 
-void	Server::sendError(const Client *client, const std::string &text)
+void	Server::sendNotice(const Client *client, const std::string &text)
 {
-	std::string	msg;
+	OutputBuffer *out = beginReply(client);
 
-	msg = "ERROR :" + text + "\r\n";
+	if (!out)
+		return ;
 
-    sendToClient(client->getClientFd(), msg);
+	ReplyBuilder rb(*out, client->getClientFd());
+
+	rb << ":" SERVER_NAME " NOTICE ";
+	if (client->getNickname().empty())
+		rb << '*';
+	else
+		rb << client->getNickname();
+	rb << " :" << text << "\r\n";
 }
 
-void	Server::sendNumeric(Client* client, int numeric, const std::string &message)
+void	Server::sendError(const Client *client, const std::string &text)
 {
-	std::ostringstream	oss;
-	std::string			numericStr;
-	std::string			fullMessage;
-	std::string			target = "*";
+	OutputBuffer *out = beginReply(client);
 
-	if (!client->getNickname().empty())
-		target = client->getNickname();
+	if (out)
+		ReplyBuilder(*out, client->getClientFd()) << "ERROR :" << text << "\r\n";
+}
 
-	if (numeric < 10)
-		oss << "00" << numeric;
-	else if (numeric < 100)
-		oss << "0" << numeric;
-	else
-		oss << numeric;
+void	Server::sendNumeric(Client* client, int numeric, const std::string &message)
+{
+	OutputBuffer *out = beginReply(client);
 
-	numericStr = oss.str();
+	if (!out)
+		return ;
 
-	fullMessage = ":" + serverConfig::serverName + " " 
-						+ numericStr + " " 
-						+ target + " :" 
-						+ message + "\r\n";
+	ReplyBuilder rb(*out, client->getClientFd());
 
-	sendToClient(client->getClientFd(), fullMessage);
+	rb << ":" SERVER_NAME " ";
+	rb.numeric(numeric) << ' ';
+	if (client->getNickname().empty())
+		rb << '*';
+	else
+		rb << client->getNickname();
+	rb << " :" << message << "\r\n";
 }
 
-void	Server::sendNameReply(Client* client, const std::string &channel,
-								const std::string &userList)
+// RPL_NAMREPLY lines from the channel's chunk cache (rebuilt here if a
+// membership change invalidated it), followed by RPL_ENDOFNAMES
+void	Server::sendNames(Client* client, const Channel *channel)
 {
-	std::string fullMessage = ":" + serverConfig::serverName
-							+ " 353 " + client->getNickname()
-							+ " = " + channel
-							+ " :" + userList + "\r\n";
+	OutputBuffer *out = beginReply(client);
+
+	if (!out)
+		return ;
+
+	NamesCache	&cache = channel->getNamesCache();
 
-	sendToClient(client->getClientFd(), fullMessage);
+	if (!cache.isValid())
+	{
+		const Channel::Member	*members = channel->getMembers().data();
+		size_t					count = channel->getMembers().size();
+
+		cache.reset();
+		for (size_t i = 0; i < count; ++i)
+		{
+			const Client *member = getClientById(members[i].id);
+
+			if (member)
+				cache.append(Channel::namesEntry(member->getNickname(), members[i].roles));
+		}
+	}
+
+	ReplyBuilder						rb(*out, client->getClientFd());
+	const std::vector<std::string>		&chunks = cache.getChunks();
+
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		rb << ":" SERVER_NAME " 353 " << client->getNickname() << " = "
+			<< channel->getName() << " :" << chunks[i] << "\r\n";
+	}
+	sendEndOfNames(client, channel->getName());
 }
 
-void	Server::sendEndOfNames(Client* client, const std::string &channel)
+void	Server::sendEndOfNames(Client* client, const StringRef &channel)
 {
-	std::string fullMessage = ":" + serverConfig::serverName
-							+ " 366 " + client->getNickname()
-							+ " " + channel
-							+ " :End of NAMES list\r\n";
+	OutputBuffer *out = beginReply(client);
 
-	sendToClient(client->getClientFd(), fullMessage);
+	if (out)
+		ReplyBuilder(*out, client->getClientFd()) << ":" SERVER_NAME " 366 "
+			<< client->getNickname() << " " << channel << " :End of NAMES list\r\n";
 }
 
 void	Server::sendToClient(int clientFd, const std::string &message)
@@ -486,57 +1014,29 @@ void	Server::sendToClient(int clientFd, const std::string &message)
 	if (clientFd == -1)
 		return; 
 
-	std::map<int, Client*>::iterator it = clientsByFd.find(clientFd);
-    if (it == clientsByFd.end())
-		return; // Client not found
-
-    Client* targetClient = it->second;
+	Client *client = getClientByFd(clientFd);
 
-	// Pending messages
-	if (!targetClient->getBufferOut().empty())
-	{
-		targetClient->appendToBufferOut(message);
-		markPollFdWritable(clientFd);
-		return;
-	}
-
-	ssize_t bytesSent = send(clientFd, message.c_str(), message.size(), 0);
+	if (!client)
+		return; // Client not found
 
-	if (bytesSent == -1)
-	{
-		if (errno == EAGAIN || errno == EWOULDBLOCK)
-		{
-			targetClient->appendToBufferOut(message);
-			markPollFdWritable(clientFd);
-		}
-		else
-		{
-			disconnectClient(targetClient, "Cannot send message.");
-		}
-	}
-	else if (bytesSent < (ssize_t)message.size())
-	{
-		targetClient->appendToBufferOut(message.substr(bytesSent));
-		markPollFdWritable(clientFd);
-	}
+	deliver(client, message);
 }
 
 void	Server::sendPendingMessages(Client* client)
 {
-	std::string& outBuffer = client->getBufferOut();
+	OutputBuffer& outBuffer = client->getBufferOut();
 
 	while (!outBuffer.empty())
 	{
-		int bytesSent = send(client->getClientFd(), outBuffer.c_str(),
-				outBuffer.size(), 0);
+		ssize_t bytesSent = outBuffer.writeTo(client->getClientFd());
 
 		if (bytesSent > 0)
 		{
-			outBuffer.erase(0, bytesSent);
+			PROBE_FLUSH(client->getClientFd(), bytesSent, outBuffer.size());
 		}
-		else if (bytesSent == -1)
+		else
 		{
-			if (errno != EAGAIN || errno != EWOULDBLOCK)
+			if (bytesSent == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
 			{
 				disconnectClient(client, "Cannot send pending message");
 			}
@@ -545,52 +1045,136 @@ void	Server::sendPendingMessages(Client* client)
 	}
 }
 
-void	Server::notifyModeChange(Channel *channel, Client *client,
-	const std::string &mode, const std::string &extra)
+void	Server::flushPendingClients()
 {
-	if (!channel || !client || mode.empty())
-		return;
+	for (size_t i = 0; i < pendingFlush.size(); ++i)
+	{
+		Client *client = getClientByFd(pendingFlush[i]);
+		if (!client || !client->isFlushQueued())
+			continue ;
 
-	std::string prefix = ":"+ client->getNickname() + "!"
-								+ client->getUsername() + "@"
-								+ client->getHostname();
+		client->setFlushQueued(false);
 
-	std::string fullMessage = prefix + " MODE " + channel->getName() + " " + mode;
+		try
+		{
+			sendPendingMessages(client);
+			// Socket buffer full: the rest leaves on POLLOUT
+			if (!client->getBufferOut().empty())
+				markPollFdWritable(client->getClientFd());
+		}
+		catch (const ClientDisconnectedException &e) {}
+	}
+	pendingFlush.clear();
+}
 
-	if (!extra.empty())
-		fullMessage += " " + extra;
+// Queues a LIST; results are produced by continueListings()
+void	Server::startListing(Client *client, const ChannelIndex::Query &query)
+{
+	ListJob	job;
 
-	fullMessage += "\r\n";
+	cancelListing(client);
+	job.client = client;
+	job.cursor.query = query;
+	listJobs.push_back(job);
+}
 
-	const std::map<std::string, const Client*> &users = channel->getUsers();
-	for (std::map<std::string, const Client*>::const_iterator it = users.begin();
-		it != users.end(); ++it)
+void	Server::cancelListing(const Client *client)
+{
+	for (size_t i = 0; i < listJobs.size(); ++i)
 	{
-		sendRaw(it->second, fullMessage);
+		if (listJobs[i].client == client)
+		{
+			listJobs[i] = listJobs.back();
+			listJobs.pop_back();
+			return ;
+		}
 	}
 }
 
-void	Server::markPollFdWritable(int fd)
+// Tops up each running LIST while its client keeps draining. A client
+// that stops reading holds its output above listLowWater and gets nothing
+// more; one that keeps up gets at most listBatch channels visited per
+// tick, with POLLOUT armed so the loop comes back for the next batch.
+void	Server::continueListings()
 {
-	for (size_t i = 0; i < pollFds.size(); ++i)
+	size_t i = 0;
+
+	while (i < listJobs.size())
 	{
-		if (pollFds[i].fd == fd)
+		ListJob			&job = listJobs[i];
+		Client			*client = job.client;
+		OutputBuffer	*out;
+
+		if (client->getBufferOut().size() >= serverConfig::listLowWater)
+		{
+			++i;
+			continue ;
+		}
+		if (!(out = beginReply(client)))
 		{
-			pollFds[i].events |= POLLOUT; // Add flag POLLOUT
-			return;
+			cancelListing(client);
+			continue ;
 		}
+
+		ReplyBuilder	rb(*out, client->getClientFd());
+		size_t			budget = serverConfig::listBatch;
+		const Channel	*channel;
+
+		while (out->size() < serverConfig::listLowWater
+			&& (channel = channelsBySize.next(job.cursor, budget)))
+		{
+			rb << ":" SERVER_NAME " ";
+			rb.numeric(RPL_LIST) << ' ' << client->getNickname() << ' '
+				<< channel->getName() << ' ' << channel->getMemberCount() << " :"
+				<< channel->getTopic() << "\r\n";
+		}
+
+		if (job.cursor.done)
+		{
+			rb << ":" SERVER_NAME " ";
+			rb.numeric(RPL_LISTEND) << ' ' << client->getNickname()
+				<< " :End of /LIST\r\n";
+			cancelListing(client);
+			continue ;
+		}
+		markPollFdWritable(client->getClientFd());
+		++i;
 	}
 }
 
-void	Server::logMessage(const std::string &msg) const
+void	Server::notifyModeChange(Channel *channel, Client *client,
+	const StringRef &modes, const StringRef &extra)
 {
-	std::time_t	now;
-	char buf[20];
-	
-	now = std::time(NULL);
-	std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+	if (!channel || !client || modes.empty())
+		return;
+
+	ArenaString	wire(commandArena);
+
+	wire << client->getPrefix() << " MODE " << channel->getName() << ' '
+		<< modes;
+	if (!extra.empty())
+		wire << ' ' << extra;
+	wire << "\r\n";
+
+	broadcast(channel, wire.ref());
+}
 
-	std::cout << "[" << buf << "] " << msg << std::endl;
+void	Server::markPollFdWritable(int fd)
+{
+	if (fd >= 0 && static_cast<size_t>(fd) < pollSlots.size() && pollSlots[fd] >= 0)
+		pollFds[pollSlots[fd]].events |= POLLOUT; // Add flag POLLOUT
+}
+
+void	Server::requestStop(int signum)
+{
+	(void)signum;
+	stopSignal = 1;
+}
+
+void	Server::requestReload(int signum)
+{
+	(void)signum;
+	reloadSignal = 1;
 }
 
 // Exception
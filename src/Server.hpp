@@ -5,10 +5,25 @@
 #include <map>
 #include <vector>
 #include <poll.h>
+#include <csignal>
+
+#include "HashRegistry.hpp"
+#include "Pool.hpp"
+#include "Arena.hpp"
+#include "ContentFilter.hpp"
+#include "HistoryStore.hpp"
+#include "MessageLog.hpp"
+#include "NickIndex.hpp"
+#include "MonitorIndex.hpp"
+#include "ChannelIndex.hpp"
+#include "StringRef.hpp"
+#include "Client.hpp"
+#include "Channel.hpp"
 
 class Channel;
 class Client;
 class Bot;
+class OutputBuffer;
 
 class Server
 {
@@ -16,11 +31,38 @@ class Server
 		int								listenFd;
 		int								port;
 		std::string						password;
-		std::map<std::string, Channel*>	channels;
-		std::map<std::string, Client*>	clientsByNick;
-		std::map<int, Client*>			clientsByFd;
+		HashRegistry<Channel>			channels;
+		ChannelIndex					channelsBySize;
+		HashRegistry<Client>			clientsByNick;	// Includes unregistered nicks
+		NickIndex						nickIndex;		// Same nicks, sorted
+		MonitorIndex					monitors;		// Nick -> MONITOR watchers
+		std::vector<Client*>			clientsByFd;	// Indexed by fd, NULL if unused
+		size_t							clientCount;
+		std::vector<Client*>			clientsById;
+		std::vector<unsigned int>		freeIds;
+		std::vector<unsigned int>		peerStamp;	// Indexed by id, see broadcastToPeers
+		unsigned int					peerEpoch;
+		ObjectPool<Client>				clientPool;
+		ObjectPool<Channel>				channelPool;
+		Arena							commandArena;
+		ContentFilter					contentFilter;
+		HistoryStore					history;		// Recent, in memory
+		MessageLog						messageLog;		// Everything, on disk
 		std::vector<struct pollfd>		pollFds;
+		std::vector<int>				pollSlots;	// fd -> index in pollFds, -1 if none
+		std::vector<int>				pendingFlush;
+		std::vector<char>				readBuffer;	// Shared recv() scratch
+		std::string						createdAt;
 		Bot*							bot;
+
+		// A LIST being streamed to a client
+		struct ListJob
+		{
+			Client					*client;
+			ChannelIndex::Cursor	cursor;
+		};
+
+		std::vector<ListJob>			listJobs;
 		
 		Server(); // Block default constructor
 
@@ -31,7 +73,13 @@ class Server
 		void	removePollFd(int fd);
 		void	sendToClient(int clientFd, const std::string &message);
 		void	sendPendingMessages(Client* client);
+		void	flushPendingClients();
+		void	continueListings();
+		void	cancelListing(const Client *client);
 		void	markPollFdWritable(int fd);
+		void	assignClientId(Client *client);
+		void	releaseClientId(Client *client);
+		void	notifyMonitors(const std::string &nick, const Client *online);
 
 	public:
 		// Constructor
@@ -42,26 +90,56 @@ class Server
 
 		// Getter
 		const std::string&	getPassword() const;
-		const std::map<std::string, Client*>&	getClientsByNick() const;
-		const std::map<std::string, Channel*>&	getChannels() const;
+		Client*	getClientById(unsigned int id) const;
+		Client*	getClientByFd(int fd) const;
+
+		// Pooled allocation
+		Client*	createClient(int fd);
+		void	destroyClient(Client *client);
+
+		// Scratch memory for the command being processed
+		Arena&	getCommandArena();
+
+		ContentFilter&	getContentFilter();
+		HistoryStore&	getHistory();
+		MessageLog&		getMessageLog();
+		const NickIndex&	getNickIndex() const;
+		MonitorIndex&		getMonitors();
+
+		// Channel lifecycle
+		Channel*	createChannel(const std::string &name);
+		void		reclaimChannel(Channel *channel);
+
+		// Lookup (casemapped)
+		Client*		findClient(const StringRef &nick) const;
+		Channel*	findChannel(const StringRef &name) const;
+		bool		claimNickname(Client *client, const std::string &nick);
+		bool		changeNickname(Client *client, const std::string &nick);
 		
 		// Execution loop
 		void	run();
 		void	disconnectClient(Client *client, const std::string &reason);
 
 		// Utilities
-		void	sendRaw(const Client *client, const std::string &text);	
+		OutputBuffer*	beginReply(const Client *client);
+		void	deliver(const Client *client, const StringRef &wire);
+		void	sendRaw(const Client *client, const StringRef &text);	
+		void	broadcast(const Channel *channel, const StringRef &wire,
+						const Client *except = NULL);
+		void	broadcastToPeers(const Client *client, const StringRef &wire);
+		void	noticeOperators(const Channel *channel, const std::string &text);
+		void	recordHistory(const Channel *channel, HistoryStore::Kind kind,
+						const IString &source, const IString &text);
 		void	sendNotice(const Client *client, const std::string &text);	
 		void	sendError(const Client *client, const std::string &text);
-		void	sendPrivMsg(const Client *from, const std::string& target,
-								const Client* to, const std::string &text);
 		void	sendNumeric(Client* client, int numeric, const std::string &message);
-		void	sendNameReply(Client* client, const std::string &channel,
-								const std::string &userList);
-		void	sendEndOfNames(Client* client, const std::string &channel);
+		void	sendNames(Client* client, const Channel *channel);
+		void	sendEndOfNames(Client* client, const StringRef &channel);
 		void	notifyModeChange(Channel *channel, Client *client,
-						const std::string &mode, const std::string &extra = "");
+						const StringRef &modes, const StringRef &extra = StringRef());
 		void	authenticateClient(Client *client);
+		void	sendStats(Client *client, const StringRef &query);
+		void	startListing(Client *client, const ChannelIndex::Query &query);
 
 		//Bot
 		void    registerBotClient(Client* c);   // add to clientsByNick
@@ -70,8 +148,11 @@ class Server
 		void    attachBot(Bot* b);
     	Bot*    getBot() const;
 
-		// Debug
-		void	logMessage(const std::string &msg) const;
+		// Signals
+		static volatile sig_atomic_t	stopSignal;
+		static volatile sig_atomic_t	reloadSignal;
+		static void	requestStop(int signum);
+		static void	requestReload(int signum);
 
 		// Exception
 		class ClientDisconnectedException : public std::exception
@@ -0,0 +1,151 @@
+#include "StringRef.hpp"
+
+#include <cstring>
+#include <cctype>
+
+// Constructor
+StringRef::StringRef() : ptr(""), len(0) {}
+
+StringRef::StringRef(const char *data, size_t size) : ptr(data), len(size) {}
+
+StringRef::StringRef(const char *cstr) : ptr(cstr), len(std::strlen(cstr)) {}
+
+StringRef::StringRef(const std::string &str) : ptr(str.data()), len(str.size()) {}
+
+// Getter
+const char*	StringRef::data() const
+{
+	return (ptr);
+}
+
+size_t	StringRef::size() const
+{
+	return (len);
+}
+
+bool	StringRef::empty() const
+{
+	return (len == 0);
+}
+
+// Out of range reads yield '\0', like indexing the end of a C string
+char	StringRef::operator[](size_t i) const
+{
+	if (i >= len)
+		return ('\0');
+	return (ptr[i]);
+}
+
+// Utilities
+std::string	StringRef::str() const
+{
+	return (std::string(ptr, len));
+}
+
+size_t	StringRef::find(char c, size_t from) const
+{
+	for (size_t i = from; i < len; ++i)
+	{
+		if (ptr[i] == c)
+			return (i);
+	}
+	return (npos);
+}
+
+StringRef	StringRef::substr(size_t pos, size_t count) const
+{
+	if (pos > len)
+		pos = len;
+	if (count > len - pos)
+		count = len - pos;
+	return (StringRef(ptr + pos, count));
+}
+
+StringRef	StringRef::trim() const
+{
+	size_t	start = 0;
+	size_t	end = len;
+
+	while (start < end && std::isspace(static_cast<unsigned char>(ptr[start])))
+		start++;
+	while (end > start && std::isspace(static_cast<unsigned char>(ptr[end - 1])))
+		end--;
+	return (StringRef(ptr + start, end - start));
+}
+
+bool	StringRef::equals(const StringRef &other) const
+{
+	return (len == other.len && std::memcmp(ptr, other.ptr, len) == 0);
+}
+
+bool	operator==(const StringRef &a, const StringRef &b)
+{
+	return (a.equals(b));
+}
+
+bool	operator!=(const StringRef &a, const StringRef &b)
+{
+	return (!a.equals(b));
+}
+
+bool	operator==(const StringRef &a, const std::string &b)
+{
+	return (a.equals(StringRef(b)));
+}
+
+bool	operator!=(const StringRef &a, const std::string &b)
+{
+	return (!a.equals(StringRef(b)));
+}
+
+bool	operator==(const std::string &a, const StringRef &b)
+{
+	return (b.equals(StringRef(a)));
+}
+
+bool	operator!=(const std::string &a, const StringRef &b)
+{
+	return (!b.equals(StringRef(a)));
+}
+
+bool	operator==(const StringRef &a, const char *b)
+{
+	return (a.equals(StringRef(b)));
+}
+
+bool	operator!=(const StringRef &a, const char *b)
+{
+	return (!a.equals(StringRef(b)));
+}
+
+std::string	operator+(const std::string &a, const StringRef &b)
+{
+	std::string	result(a);
+
+	result.append(b.data(), b.size());
+	return (result);
+}
+
+std::string	operator+(const StringRef &a, const std::string &b)
+{
+	std::string	result(a.data(), a.size());
+
+	result.append(b);
+	return (result);
+}
+
+std::string	operator+(const char *a, const StringRef &b)
+{
+	std::string	result(a);
+
+	result.append(b.data(), b.size());
+	return (result);
+}
+
+std::string	operator+(const StringRef &a, const char *b)
+{
+	std::string	result(a.data(), a.size());
+
+	result.append(b);
+	return (result);
+}
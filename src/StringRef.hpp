@@ -0,0 +1,55 @@
+#ifndef STRINGREF_HPP
+#define STRINGREF_HPP
+
+#include <string>
+#include <cstddef>
+
+// Non-owning view of a run of characters. Command tokens are StringRefs
+// into the client's input buffer (or into the per-command Arena), so
+// parsing a line copies nothing. A StringRef is only valid while the
+// bytes it points to are; call str() to keep a value past the command.
+class StringRef
+{
+	private:
+		const char	*ptr;
+		size_t		len;
+
+	public:
+		static const size_t	npos = static_cast<size_t>(-1);
+
+		// Constructor
+		StringRef();
+		StringRef(const char *data, size_t size);
+		StringRef(const char *cstr);
+		StringRef(const std::string &str);
+
+		// Getter
+		const char*	data() const;
+		size_t		size() const;
+		bool		empty() const;
+		char		operator[](size_t i) const;
+
+		// Utilities
+		std::string	str() const;
+		size_t		find(char c, size_t from = 0) const;
+		StringRef	substr(size_t pos, size_t count = npos) const;
+		StringRef	trim() const;
+		bool		equals(const StringRef &other) const;
+};
+
+bool		operator==(const StringRef &a, const StringRef &b);
+bool		operator!=(const StringRef &a, const StringRef &b);
+bool		operator==(const StringRef &a, const std::string &b);
+bool		operator!=(const StringRef &a, const std::string &b);
+bool		operator==(const std::string &a, const StringRef &b);
+bool		operator!=(const std::string &a, const StringRef &b);
+bool		operator==(const StringRef &a, const char *b);
+bool		operator!=(const StringRef &a, const char *b);
+
+// Concatenation into an owned string, for the cold (error reply) paths
+std::string	operator+(const std::string &a, const StringRef &b);
+std::string	operator+(const StringRef &a, const std::string &b);
+std::string	operator+(const char *a, const StringRef &b);
+std::string	operator+(const StringRef &a, const char *b);
+
+#endif
@@ -0,0 +1,62 @@
+#include "TokenList.hpp"
+#include "Arena.hpp"
+
+#include <cstring>
+
+static const StringRef	emptyToken;
+
+// Constructor
+TokenList::TokenList(Arena &arena, size_t capacity) : arena(&arena),
+	items(NULL), count(0), cap(capacity ? capacity : 1)
+{
+	items = arena.allocArray<StringRef>(cap);
+}
+
+// Getter
+size_t	TokenList::size() const
+{
+	return (count);
+}
+
+bool	TokenList::empty() const
+{
+	return (count == 0);
+}
+
+const StringRef	&TokenList::operator[](size_t i) const
+{
+	if (i >= count)
+		return (emptyToken);
+	return (items[i]);
+}
+
+// Utilities
+void	TokenList::push_back(const StringRef &token)
+{
+	if (count == cap)
+	{
+		StringRef *grown = arena->allocArray<StringRef>(cap * 2);
+
+		std::memcpy(static_cast<void*>(grown), items, count * sizeof(StringRef));
+		items = grown;
+		cap *= 2;
+	}
+	items[count++] = token;
+}
+
+TokenList	TokenList::split(Arena &arena, const StringRef &list, char delimiter)
+{
+	TokenList	result(arena);
+	size_t		start = 0;
+
+	while (start < list.size())
+	{
+		size_t end = list.find(delimiter, start);
+
+		if (end == StringRef::npos)
+			end = list.size();
+		result.push_back(list.substr(start, end - start));
+		start = end + 1;
+	}
+	return (result);
+}
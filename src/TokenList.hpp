@@ -0,0 +1,40 @@
+#ifndef TOKENLIST_HPP
+#define TOKENLIST_HPP
+
+#include "StringRef.hpp"
+
+#include <cstddef>
+
+class Arena;
+
+// Growable array of StringRefs whose storage comes from an Arena.
+// Used for a command's parameters and for comma separated lists
+// (JOIN/PART targets and keys); everything goes away on Arena::reset().
+class TokenList
+{
+	private:
+		Arena		*arena;
+		StringRef	*items;
+		size_t		count;
+		size_t		cap;
+
+		TokenList(); // Block default constructor
+
+	public:
+		// Constructor
+		explicit TokenList(Arena &arena, size_t capacity = 8);
+
+		// Getter
+		size_t			size() const;
+		bool			empty() const;
+		// Past the end reads yield an empty StringRef
+		const StringRef	&operator[](size_t i) const;
+
+		// Utilities
+		void	push_back(const StringRef &token);
+
+		// "a,,b," -> a, "", b (same items as std::getline would give)
+		static TokenList	split(Arena &arena, const StringRef &list, char delimiter);
+};
+
+#endif
@@ -1,5 +1,10 @@
 #include "Utils.hpp"
 #include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <ctime>
+#include <sys/time.h>
 
 namespace Utils
 {
@@ -53,4 +58,63 @@ namespace Utils
 
 		return (oss.str());
 	}
+
+	unsigned long	nowMillis()
+	{
+		struct timeval	tv;
+
+		gettimeofday(&tv, NULL);
+		return (static_cast<unsigned long>(tv.tv_sec) * 1000 + tv.tv_usec / 1000);
+	}
+
+	// IRCv3 server-time: "YYYY-MM-DDThh:mm:ss.sssZ" (UTC)
+	std::string	formatServerTime(unsigned long ms)
+	{
+		time_t		sec = static_cast<time_t>(ms / 1000);
+		struct tm	utc;
+		char		text[32];
+
+		gmtime_r(&sec, &utc);
+		std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &utc);
+		std::snprintf(text + 19, sizeof(text) - 19, ".%03luZ", ms % 1000);
+		return (text);
+	}
+
+	bool	parseServerTime(const std::string &text, unsigned long &ms)
+	{
+		struct tm	utc;
+		unsigned	millis = 0;
+		int			used = 0;
+
+		std::memset(&utc, 0, sizeof(utc));
+		if (std::sscanf(text.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d%n", &utc.tm_year,
+				&utc.tm_mon, &utc.tm_mday, &utc.tm_hour, &utc.tm_min, &utc.tm_sec,
+				&used) != 6)
+			return (false);
+		if (text[used] == '.')
+		{
+			int digits = 0;
+
+			while (std::isdigit(static_cast<unsigned char>(text[used + 1 + digits])))
+			{
+				if (digits < 3)
+					millis = millis * 10 + (text[used + 1 + digits] - '0');
+				++digits;
+			}
+			while (digits < 3)
+			{
+				millis *= 10;
+				++digits;
+			}
+		}
+		utc.tm_year -= 1900;
+		utc.tm_mon -= 1;
+
+		time_t sec = timegm(&utc);
+
+		if (sec < 0)
+			return (false);
+		ms = static_cast<unsigned long>(sec) * 1000 + millis;
+		return (true);
+	}
 }
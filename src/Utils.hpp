@@ -10,6 +10,12 @@ namespace Utils
 	std::vector<std::string>	splitBySpace(const std::string &input);
 	std::string					trim(const std::string &str);
 	std::string					toString(int value);
+
+	// Wall clock in milliseconds and its IRCv3 server-time form
+	unsigned long				nowMillis();
+	std::string					formatServerTime(unsigned long ms);
+	bool						parseServerTime(const std::string &text,
+									unsigned long &ms);
 }
 
 #endif
@@ -8,12 +8,15 @@
 #include <fcntl.h>
 #include <string>
 
-#define BUFFER_SIZE 1024
+#define BUFFER_SIZE 16384 // Shared read scratch, one per event loop
+#define SERVER_NAME "ircserv"
+#define SERVER_VERSION "ircserv-1.0"
 
 namespace	serverConfig
 {
 	// Server settings
-	const std::string	serverName = "ircserv";
+	const std::string	serverName = SERVER_NAME;
+	const std::string	caseMapping = "rfc1459"; // "rfc1459" or "ascii"
 	
 	// Socket settings
 	const int domain = AF_INET; // IPv4
@@ -34,6 +37,59 @@ namespace	serverConfig
 	const int fcntlCmd = F_SETFL; // Command to set file descriptor flags
 	const int fcntlFlag = O_NONBLOCK; // Non-blocking mode flag
 
+	// Name limits (advertised as NICKLEN)
+	const size_t	nickLen = 30;
+
+	// Targets per PRIVMSG/NOTICE (advertised as TARGMAX)
+	const size_t	maxTargets = 20;
+
+	// Parameterised modes per MODE line (advertised as MODES)
+	const size_t	maxModeParams = 4;
+
+	// Masks per +b/+e/+I list (advertised as MAXLIST)
+	const size_t	maxListEntries = 100;
+
+	// Nicks one client may MONITOR (advertised as MONITOR)
+	const size_t	maxMonitor = 100;
+
+	// Channel limits (advertised as CHANLIMIT / CHANNELLEN)
+	const size_t	maxChannels = 10000;		// Channels alive at once, server wide
+	const size_t	maxChannelsPerUser = 20;	// Channels one client may be in
+	const size_t	channelNameLen = 50;
+
+	// Content filter rules ("<drop|notify|kill> <phrase>" per line, SIGHUP reloads)
+	const std::string	filterFile = "filter.conf";
+	const size_t		filterMaxPatterns = 20000;
+
+	// LIST pacing: more results are generated only while the client's
+	// output queue is below listLowWater, visiting at most listBatch
+	// channels per loop tick
+	const size_t	listLowWater = 8 * 1024;
+	const size_t	listBatch = 512;
+
+	// Channel history (CHATHISTORY): records kept per channel, bytes for
+	// all channels together (the quietest channels are trimmed first) and
+	// records per query (advertised as CHATHISTORY)
+	const size_t	historyPerChannel = 500;
+	const size_t	historyBudget = 8 * 1024 * 1024;
+	const size_t	historyQueryLimit = 100;
+
+	// Persistent channel log: fixed-size frames in segments of
+	// logSegmentRecords, a sparse index entry every logIndexStride frames,
+	// dirty segments synced every logSyncMillis (group commit)
+	const std::string	logDir = "history";
+	const size_t		logRecordBytes = 1024;
+	const size_t		logSegmentRecords = 4096;
+	const size_t		logIndexStride = 64;
+	const unsigned long	logSyncMillis = 1000;
+	const size_t		logMaxOpenSegments = 256;	// Writer thread fds
+	const size_t		logMaxMappedSegments = 64;	// Read mappings, LRU
+
+	// Memory pools
+	const size_t	slabBytes = 64 * 1024;	// Slab size for Client/Channel/I/O pools
+	const bool		hugePages = false;		// Back slabs with 2MB huge pages
+	const size_t	arenaBytes = 16 * 1024;	// Per-command scratch arena
+
 	// poll settings
     const short pollReadEvent = POLLIN;  // Ready to read
     const short pollWriteEvent = POLLOUT; // Ready to write
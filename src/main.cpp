@@ -1,9 +1,11 @@
 #include "Server.hpp"
+#include "Logger.hpp"
 
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <cstdlib>
+#include <csignal>
 
 bool	parsePort(const std::string &str, int &port)
 {
@@ -38,6 +40,12 @@ int	main(int ac, char **av)
 		return (EXIT_FAILURE);
 	}
 
+	std::signal(SIGINT, &Server::requestStop);
+	std::signal(SIGTERM, &Server::requestStop);
+	std::signal(SIGHUP, &Server::requestReload);
+	std::signal(SIGPIPE, SIG_IGN);
+
+	Logger::start();
 	try
 	{
 		Server server(port, password);
@@ -45,9 +53,11 @@ int	main(int ac, char **av)
 		server.run();
 
 	} catch (const std::exception &e) {
+		Logger::stop();
 		std::cerr << "Error: " << e.what() << std::endl;
 		return (EXIT_FAILURE);
 	}
+	Logger::stop();
 
 	return (EXIT_SUCCESS);
 }
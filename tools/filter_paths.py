@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""
+Content filter actions end to end: DROP, NOTIFY and KILL on channel and
+mixed channel/private targets, and a SIGHUP reload. Run from the
+repository root after make:
+
+  python3 tools/filter_paths.py [port]
+
+The server runs in a scratch directory holding its filter.conf.
+"""
+
+import os, shutil, signal, socket, subprocess, sys, tempfile, time
+
+PORT = int(sys.argv[1]) if len(sys.argv) > 1 else 6690
+SERVER = os.path.abspath("ircserv")
+failures = 0
+
+
+class Client:
+    def __init__(self, nick):
+        self.sock = socket.create_connection(("127.0.0.1", PORT))
+        self.sock.settimeout(0.3)
+        self.send("PASS pw")
+        self.send("NICK " + nick)
+        self.send("USER %s host 0 :%s" % (nick, nick))
+
+    def send(self, line):
+        self.sock.sendall((line + "\r\n").encode())
+
+    def read(self):
+        time.sleep(0.25)
+        out = b""
+        try:
+            while True:
+                data = self.sock.recv(65536)
+                if not data:
+                    break
+                out += data
+        except (socket.timeout, ConnectionResetError):
+            pass
+        return out.decode(errors="replace")
+
+
+def check(ok, what):
+    global failures
+    if not ok:
+        failures += 1
+        print("FAIL:", what)
+
+
+def main():
+    scratch = tempfile.mkdtemp(prefix="filter_paths.")
+    conf = os.path.join(scratch, "filter.conf")
+    with open(conf, "w") as f:
+        f.write("drop buy cheap\nnotify http://spam.example\nkill killword\n")
+
+    server = subprocess.Popen([SERVER, str(PORT), "pw"], cwd=scratch,
+                              stdout=subprocess.DEVNULL)
+    time.sleep(0.5)
+    try:
+        alice, bob, carol = Client("alice"), Client("bob"), Client("carol")
+        alice.send("JOIN #c")
+        bob.send("JOIN #c")
+        for c in (alice, bob, carol):
+            c.read()
+
+        bob.send("PRIVMSG #c :hello there")
+        check("hello there" in alice.read(), "clean text is delivered")
+
+        # DROP: silently withheld from channels, private targets still served
+        bob.send("PRIVMSG #c :please BUY Cheap watches")
+        check(alice.read() == "", "drop withholds channel text")
+        bob.send("PRIVMSG carol,#c :buy cheap direct")
+        check("direct" in carol.read(), "drop keeps the private target")
+        check(alice.read() == "", "drop withholds the channel target")
+
+        # NOTIFY: delivered, operators get a notice naming the sender
+        bob.send("PRIVMSG #c :see HTTP://spam.example/x")
+        got = alice.read()
+        check("see HTTP" in got, "notify delivers the text")
+        check("Filter: bob matched" in got, "notify tells the operator")
+
+        # KILL: decided before delivery, nobody receives the text
+        bob.send("PRIVMSG carol,#c :KillWord")
+        check("ERROR" in bob.read(), "kill disconnects the sender")
+        check("KillWord" not in carol.read(), "kill reaches no private target")
+        check("KillWord" not in alice.read(), "kill reaches no channel")
+
+        # Reload on SIGHUP swaps rules without a restart
+        with open(conf, "w") as f:
+            f.write("drop newrule\n")
+        server.send_signal(signal.SIGHUP)
+        time.sleep(0.5)
+        carol.send("JOIN #c")
+        carol.read()
+        alice.read()
+        carol.send("PRIVMSG #c :buy cheap now")
+        check("buy cheap now" in alice.read(), "old rule gone after reload")
+        carol.send("PRIVMSG #c :a NewRule here")
+        check(alice.read() == "", "new rule active after reload")
+    finally:
+        server.send_signal(signal.SIGINT)
+        server.wait(5)
+        shutil.rmtree(scratch)
+
+    print("FAILED" if failures else "OK")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
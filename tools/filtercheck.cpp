@@ -0,0 +1,256 @@
+// Checks ContentFilter against a naive scan and times both.
+//
+//   make filtercheck && ./filtercheck
+//
+// Every text is scanned by the automaton and by std::string::find with
+// each pattern on the lowercased text; the strongest action must agree,
+// and the pattern reported must occur in the text with that action. Two
+// rule sets are used: few start bytes (SSE2 skip) and many (scalar skip).
+// Reloads are checked too: old rules serve until the background build is
+// adopted, and a broken file keeps the previous rules.
+
+#include "ContentFilter.hpp"
+#include "StringRef.hpp"
+
+#include <string>
+#include <vector>
+#include <set>
+#include <fstream>
+#include <iostream>
+#include <cctype>
+#include <cstdio>
+#include <sys/time.h>
+#include <unistd.h>
+
+struct Rule
+{
+	ContentFilter::Action	action;
+	std::string				pattern;	// Lowercase
+};
+
+static const char		*rulePath = "filtercheck.conf";
+static unsigned long	seed = 42;
+static int				failures = 0;
+
+static unsigned long	nextRandom()
+{
+	seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+	return (seed >> 33);
+}
+
+static double	nowSeconds()
+{
+	struct timeval	tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+static void	check(bool ok, const std::string &what)
+{
+	if (!ok)
+	{
+		++failures;
+		std::cout << "FAIL: " << what << std::endl;
+	}
+}
+
+static void	writeRules(const std::vector<Rule> &rules, const std::string &extra)
+{
+	std::ofstream	file(rulePath);
+
+	for (size_t i = 0; i < rules.size(); ++i)
+		file << ContentFilter::actionName(rules[i].action) << ' ' << rules[i].pattern << '\n';
+	file << extra;
+}
+
+// Polls until the background build with n patterns has been adopted
+static bool	waitForPatterns(ContentFilter &filter, size_t n)
+{
+	for (int i = 0; i < 400; ++i)
+	{
+		if (filter.getStats().patterns == n)
+			return (true);
+		usleep(5000);
+	}
+	return (false);
+}
+
+static ContentFilter::Action	naiveScan(const std::vector<Rule> &rules,
+									const std::string &text)
+{
+	std::string				lower(text);
+	ContentFilter::Action	best = ContentFilter::NONE;
+
+	for (size_t i = 0; i < lower.size(); ++i)
+		lower[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(lower[i])));
+	for (size_t i = 0; i < rules.size(); ++i)
+	{
+		if (rules[i].action > best && lower.find(rules[i].pattern) != std::string::npos)
+			best = rules[i].action;
+	}
+	return (best);
+}
+
+static bool	reportedPatternFits(const std::vector<Rule> &rules, const std::string &text,
+				const ContentFilter::Match &match)
+{
+	if (match.action == ContentFilter::NONE)
+		return (match.pattern == NULL);
+
+	std::string	lower(text);
+
+	for (size_t i = 0; i < lower.size(); ++i)
+		lower[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(lower[i])));
+	for (size_t i = 0; i < rules.size(); ++i)
+	{
+		if (rules[i].pattern == *match.pattern)
+			return (rules[i].action == match.action
+				&& lower.find(rules[i].pattern) != std::string::npos);
+	}
+	return (false);
+}
+
+// Random filler from a small alphabet, with patterns spliced in at
+// random positions and in random case
+static std::string	makeText(const std::vector<Rule> &rules)
+{
+	static const char	alphabet[] = "abcdehikpsy :/.";
+	size_t				len = nextRandom() % 400;
+	std::string			text;
+
+	while (text.size() < len)
+	{
+		if (nextRandom() % 40 == 0 && !rules.empty())
+		{
+			std::string piece = rules[nextRandom() % rules.size()].pattern;
+
+			if (nextRandom() % 3 == 0)
+				piece.erase(piece.size() - 1);	// Near miss
+			for (size_t i = 0; i < piece.size(); ++i)
+			{
+				if (nextRandom() % 2)
+					piece[i] = static_cast<char>(std::toupper(static_cast<unsigned char>(piece[i])));
+			}
+			text += piece;
+		}
+		else
+			text += alphabet[nextRandom() % (sizeof(alphabet) - 1)];
+	}
+	return (text);
+}
+
+static void	compare(ContentFilter &filter, const std::vector<Rule> &rules,
+				const std::string &label, size_t count)
+{
+	std::vector<std::string>	texts;
+	size_t						bytes = 0;
+	size_t						mismatches = 0;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		texts.push_back(makeText(rules));
+		bytes += texts.back().size();
+	}
+
+	for (size_t i = 0; i < texts.size(); ++i)
+	{
+		ContentFilter::Match	match = filter.scan(StringRef(texts[i]));
+
+		if (match.action != naiveScan(rules, texts[i])
+			|| !reportedPatternFits(rules, texts[i], match))
+		{
+			if (++mismatches <= 3)
+				check(false, label + ": \"" + texts[i] + "\"");
+		}
+	}
+
+	double	start = nowSeconds();
+	size_t	hits = 0;
+
+	for (size_t i = 0; i < texts.size(); ++i)
+		hits += filter.scan(StringRef(texts[i])).action != ContentFilter::NONE;
+
+	double	automaton = nowSeconds() - start;
+
+	start = nowSeconds();
+	for (size_t i = 0; i < texts.size(); ++i)
+		hits += naiveScan(rules, texts[i]) != ContentFilter::NONE;
+
+	double	naive = nowSeconds() - start;
+
+	std::printf("%-16s %5lu patterns %7lu texts  mismatches %lu  "
+		"automaton %7.1f MB/s  naive %7.1f MB/s  (hits %lu)\n",
+		label.c_str(), static_cast<unsigned long>(rules.size()),
+		static_cast<unsigned long>(texts.size()), static_cast<unsigned long>(mismatches),
+		bytes / automaton / 1e6, bytes / naive / 1e6, static_cast<unsigned long>(hits));
+}
+
+static void	addRule(std::vector<Rule> &rules, ContentFilter::Action action,
+				const std::string &pattern)
+{
+	Rule	rule = { action, pattern };
+
+	rules.push_back(rule);
+}
+
+int	main()
+{
+	ContentFilter		filter(rulePath);
+	std::vector<Rule>	few;
+	std::vector<Rule>	many;
+
+	// Few start bytes, overlapping patterns for the failure links
+	addRule(few, ContentFilter::DROP, "buy cheap");
+	addRule(few, ContentFilter::NOTIFY, "http://spam.example");
+	addRule(few, ContentFilter::KILL, "killword");
+	addRule(few, ContentFilter::NOTIFY, "he");
+	addRule(few, ContentFilter::DROP, "she");
+	addRule(few, ContentFilter::NOTIFY, "his");
+	addRule(few, ContentFilter::DROP, "hers");
+
+	// Many start bytes: scalar skip path
+	std::set<std::string>	seen;
+
+	while (many.size() < 300)
+	{
+		std::string word;
+
+		for (size_t n = 3 + nextRandom() % 5; n > 0; --n)
+			word += "abcdehikpsy"[nextRandom() % 11];
+		if (seen.insert(word).second)
+			addRule(many, static_cast<ContentFilter::Action>(1 + nextRandom() % 3), word);
+	}
+
+	writeRules(few, "");
+	filter.reload();
+	check(waitForPatterns(filter, few.size()), "initial build adopted");
+	compare(filter, few, "few start bytes", 20000);
+
+	// Severity: the strongest hit wins, wherever it sits
+	check(filter.scan(StringRef("HERS then KillWord")).action == ContentFilter::KILL,
+		"kill outranks drop");
+	check(filter.scan(StringRef("http://spam.example buy cheap")).action
+		== ContentFilter::DROP, "drop outranks notify");
+	check(filter.scan(StringRef(std::string(1000, 'z') + "buy cheap")).action
+		== ContentFilter::DROP, "match after a long skip");
+	check(filter.scan(StringRef(std::string(1000, 'z') + "buy chap")).action
+		== ContentFilter::NONE, "near miss after a long skip");
+
+	// Reload: the old rules serve until the new build is adopted
+	writeRules(many, "");
+	filter.reload();
+	check(waitForPatterns(filter, many.size()), "reload adopted");
+	compare(filter, many, "many start bytes", 20000);
+
+	// A broken file is reported and the previous rules stay
+	writeRules(few, "explode boom\n");
+	filter.reload();
+	usleep(200000);
+	check(filter.getStats().patterns == many.size(), "broken file keeps rules");
+	compare(filter, many, "after bad reload", 2000);
+
+	std::remove(rulePath);
+	std::cout << (failures ? "FAILED" : "OK") << std::endl;
+	return (failures ? 1 : 0);
+}